@@ -0,0 +1,93 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "boot.h"
+#include <atomic>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "console.h"
+
+namespace boot
+{
+    static const char *TAG = "TONEX_CONTROLLER_BOOT";
+    static const char *PHASE_NAMES[] = {"USB host installed", "CDC-ACM installed", "Device opened", "Hello received", "State received", "MIDI UART ready"};
+
+    // Microseconds since boot, 0 - not reached yet
+    static std::atomic<uint32_t> timestamps[PHASES];
+    static std::atomic<bool> logged{false};
+
+    void mark(Phase phase)
+    {
+        uint32_t expected = 0;
+        uint32_t now = static_cast<uint32_t>(esp_timer_get_time());
+        if (!timestamps[phase].compare_exchange_strong(expected, now ? now : 1))
+        {
+            return;
+        }
+        for (int i = 0; i < PHASES; i++)
+        {
+            if (!timestamps[i])
+            {
+                return;
+            }
+        }
+        if (!logged.exchange(true))
+        {
+            log();
+        }
+    }
+
+    static void timeline(bool toConsole)
+    {
+        uint32_t ready = 0;
+        for (int i = 0; i < PHASES; i++)
+        {
+            uint32_t timestamp = timestamps[i];
+            if (timestamp)
+            {
+                console::printLine(toConsole, TAG, "%-20s %6" PRIu32 " ms", PHASE_NAMES[i], timestamp / 1000);
+            }
+            else
+            {
+                console::printLine(toConsole, TAG, "%-20s      -", PHASE_NAMES[i]);
+            }
+            ready = timestamp > ready ? timestamp : ready;
+        }
+        if (timestamps[StateReceived] && timestamps[MidiReady])
+        {
+            console::printLine(toConsole, TAG, "Time to ready: %" PRIu32 " ms", ready / 1000);
+        }
+    }
+
+    void log()
+    {
+        timeline(false);
+    }
+
+    void print()
+    {
+        timeline(true);
+    }
+}
@@ -0,0 +1,48 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+// Startup timeline. Each phase is stamped the first time it is reached; once
+// the pedal state is known and MIDI is listening the controller is ready and
+// the timeline is logged.
+namespace boot {
+    enum Phase {
+        UsbHostInstalled,
+        CdcInstalled,
+        DeviceOpened,
+        Helloed,
+        StateReceived,
+        MidiReady,
+        PHASES
+    };
+
+    void mark(Phase phase);
+    // Timeline through the log, done once when ready
+    void log();
+    // Timeline on the console
+    void print();
+}
@@ -0,0 +1,71 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+
+// Stack sizes (in bytes), priorities and cores of all long-lived tasks, and
+// sizes of static buffers. Check the memory report before shrinking a stack.
+namespace config {
+    static const uint32_t USB_HOST_TASK_STACK = 4096;
+    static const UBaseType_t USB_HOST_TASK_PRIORITY = 5;
+    static const BaseType_t USB_HOST_TASK_CORE = 0;
+
+    static const uint32_t USB_LIB_TASK_STACK = 4096;
+    static const UBaseType_t USB_LIB_TASK_PRIORITY = 20;
+    static const BaseType_t USB_LIB_TASK_CORE = tskNO_AFFINITY;
+
+    static const uint32_t MIDI_TASK_STACK = 4096;
+    static const UBaseType_t MIDI_TASK_PRIORITY = 10;
+    static const BaseType_t MIDI_TASK_CORE = 0;
+
+    static const uint32_t LINK_SUPERVISOR_TASK_STACK = 3072;
+    static const UBaseType_t LINK_SUPERVISOR_TASK_PRIORITY = 3;
+    static const BaseType_t LINK_SUPERVISOR_TASK_CORE = 0;
+
+    static const uint32_t PRELOAD_TASK_STACK = 3072;
+    static const UBaseType_t PRELOAD_TASK_PRIORITY = 2;
+    static const BaseType_t PRELOAD_TASK_CORE = 0;
+
+    static const uint32_t TRACE_TASK_STACK = 3072;
+    static const UBaseType_t TRACE_TASK_PRIORITY = 1;
+    static const BaseType_t TRACE_TASK_CORE = 1;
+
+    static const uint32_t CONSOLE_TASK_STACK = 4096;
+    static const UBaseType_t CONSOLE_TASK_PRIORITY = 1;
+    static const BaseType_t CONSOLE_TASK_CORE = 1;
+
+    static const int MIDI_UART_BUFFER_SIZE = 128;
+    static const int MIDI_TX_BUFFER_SIZE = 256;
+    // Upper bound of a single pedal message kept in the receive buffer
+    static const size_t MESSAGE_BUFFER_SIZE = 2048;
+    static const int CONSOLE_LINE_SIZE = 128;
+    // Scenes are stored as complete pedal state bodies, together with their set state frame
+    static const int SCENE_COUNT = 8;
+    static const size_t SCENE_MAX_SIZE = 256;
+    // Set state header (11) and CRC (2) with every byte escaped, plus both flags
+    static const size_t SCENE_FRAME_SIZE = 2 * (SCENE_MAX_SIZE + 13) + 2;
+}
@@ -0,0 +1,348 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "console.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#ifdef CONFIG_IDF_TARGET_LINUX
+#include <poll.h>
+#include <unistd.h>
+#else
+#include "driver/uart.h"
+#endif
+#include "esp_log.h"
+#include "config.h"
+#include "mapping.h"
+#include "scenes.h"
+#include "metrics.h"
+#include "report.h"
+#include "tonex.h"
+#include "boot.h"
+
+namespace console
+{
+#ifdef CONFIG_IDF_TARGET_LINUX
+    // Tasks of the simulated scheduler must not sit in a system call for long
+    static const int STDIN_POLL_MS = 20;
+#elif defined(CONFIG_ESP_CONSOLE_UART_NUM)
+    static const uart_port_t UART_PORT_NUM = static_cast<uart_port_t>(CONFIG_ESP_CONSOLE_UART_NUM);
+#else
+    static const uart_port_t UART_PORT_NUM = UART_NUM_0;
+#endif
+
+    static const int MAX_ARGS = 8;
+
+    static char line[config::CONSOLE_LINE_SIZE];
+    static const char slotName[] = {'A', 'B', 'C'};
+    static const char *healthName[] = {"healthy", "degraded", "dead"};
+    static const char *connectionName[] = {"disconnected", "connected", "helloed", "ready"};
+
+    static bool parseSlot(const char *text, Slot &slot)
+    {
+        switch (text[0])
+        {
+        case 'A':
+        case 'a':
+            slot = Slot::A;
+            return true;
+        case 'B':
+        case 'b':
+            slot = Slot::B;
+            return true;
+        case 'C':
+        case 'c':
+            slot = Slot::C;
+            return true;
+        }
+        return false;
+    }
+
+    static bool parseNumber(const char *text, long min, long max, long &value)
+    {
+        char *end;
+        value = strtol(text, &end, 10);
+        return *text && !*end && value >= min && value <= max;
+    }
+
+    static void help()
+    {
+        printf("help                                  this list\n"
+               "state                                 cached pedal state and link health\n"
+               "refresh                               request state from the pedal\n"
+               "presets [fetch]                       preset names, fetch all in one transfer\n"
+               "slot <A|B|C>                          activate slot\n"
+               "preset <A|B|C> <0-19>                 load preset into slot\n"
+               "switch <0-19>                         switch silently to preset\n"
+               "stats                                 counters and histograms\n"
+               "mem                                   memory report\n"
+               "boot                                  startup timeline\n"
+               "scene save|recall|clear <n>           capture, restore or delete a scene\n"
+               "scene list                            stored scenes\n"
+               "map <ch 1-16> <prog 0-127> <action 0-4> [slot] [preset|scene]\n"
+               "map move <from ch> <to ch>            change MIDI channel of a mapping\n"
+               "map save | map reset                  store or restore default mapping\n"
+               "log <0-5>                             log level\n");
+    }
+
+    static const char *execute(Tonex *tonex, int argc, char **argv)
+    {
+        Slot slot;
+        long value;
+        if (!strcmp(argv[0], "help"))
+        {
+            help();
+        }
+        else if (!strcmp(argv[0], "state"))
+        {
+            auto state = tonex->getState();
+            printf("version %" PRIu32 "\n", state.version);
+            printf("connection %s\n", connectionName[tonex->getConnectionState()]);
+            printf("link %s\n", healthName[tonex->getLinkHealth()]);
+            printf("slot %c\n", state.currentSlot <= Slot::C ? slotName[state.currentSlot] : '?');
+            printf("presets A %d B %d C %d\n", state.slotAPreset, state.slotBPreset, state.slotCPreset);
+            printf("trim %.1f cab bypass %d tuning %d a4 %d monitoring %d tempo %.1f (source %d)\n", state.settings.inputTrim,
+                   state.settings.cabSimBypass, state.settings.tuningMode, state.settings.a4Reference, state.settings.directMonitoring,
+                   state.settings.tempo, state.settings.tempoSource);
+        }
+        else if (!strcmp(argv[0], "refresh"))
+        {
+            tonex->requestState();
+        }
+        else if (!strcmp(argv[0], "presets"))
+        {
+            if (argc == 2 && !strcmp(argv[1], "fetch"))
+            {
+                tonex->requestPresets();
+                return nullptr;
+            }
+            if (argc != 1)
+            {
+                return "usage: presets [fetch]";
+            }
+            for (int preset = 0; preset < PRESET_COUNT; preset++)
+            {
+                char name[PRESET_NAME_SIZE];
+                printf("%2d %s\n", preset, tonex->getPresetName(preset, name, sizeof(name)) ? name : "-");
+            }
+        }
+        else if (!strcmp(argv[0], "slot"))
+        {
+            if (argc != 2 || !parseSlot(argv[1], slot))
+            {
+                return "usage: slot <A|B|C>";
+            }
+            tonex->setSlot(slot);
+        }
+        else if (!strcmp(argv[0], "preset"))
+        {
+            if (argc != 3 || !parseSlot(argv[1], slot) || !parseNumber(argv[2], 0, 19, value))
+            {
+                return "usage: preset <A|B|C> <0-19>";
+            }
+            tonex->changePreset(slot, value);
+        }
+        else if (!strcmp(argv[0], "switch"))
+        {
+            if (argc != 2 || !parseNumber(argv[1], 0, 19, value))
+            {
+                return "usage: switch <0-19>";
+            }
+            tonex->switchSilently(value);
+        }
+        else if (!strcmp(argv[0], "stats"))
+        {
+            metrics::print();
+        }
+        else if (!strcmp(argv[0], "mem"))
+        {
+            report::print();
+        }
+        else if (!strcmp(argv[0], "boot"))
+        {
+            boot::print();
+        }
+        else if (!strcmp(argv[0], "scene"))
+        {
+            if (argc == 2 && !strcmp(argv[1], "list"))
+            {
+                scenes::list();
+                return nullptr;
+            }
+            if (argc != 3 || !parseNumber(argv[2], 0, config::SCENE_COUNT - 1, value))
+            {
+                return "usage: scene save|recall|clear <n> | scene list";
+            }
+            if (!strcmp(argv[1], "save"))
+            {
+                return scenes::save(value, tonex) == ESP_OK ? nullptr : "saving failed";
+            }
+            if (!strcmp(argv[1], "recall"))
+            {
+                return scenes::recall(value, tonex) ? nullptr : "recall failed";
+            }
+            if (!strcmp(argv[1], "clear"))
+            {
+                return scenes::clear(value) == ESP_OK ? nullptr : "clearing failed";
+            }
+            return "usage: scene save|recall|clear <n> | scene list";
+        }
+        else if (!strcmp(argv[0], "map"))
+        {
+            long channel, program, action, preset = 0, to;
+            if (argc == 2 && !strcmp(argv[1], "save"))
+            {
+                return mapping::save() == ESP_OK ? nullptr : "saving failed";
+            }
+            if (argc == 2 && !strcmp(argv[1], "reset"))
+            {
+                mapping::reset();
+                return nullptr;
+            }
+            if (argc == 4 && !strcmp(argv[1], "move"))
+            {
+                if (!parseNumber(argv[2], 1, 16, channel) || !parseNumber(argv[3], 1, 16, to))
+                {
+                    return "usage: map move <from ch> <to ch>";
+                }
+                mapping::moveChannel(channel - 1, to - 1);
+                return nullptr;
+            }
+            slot = Slot::A;
+            if (argc < 4 || argc > 6 || !parseNumber(argv[1], 1, 16, channel) || !parseNumber(argv[2], 0, 127, program) ||
+                !parseNumber(argv[3], 0, 4, action) || (argc > 4 && !parseSlot(argv[4], slot)) || (argc > 5 && !parseNumber(argv[5], 0, 19, preset)) ||
+                (action == static_cast<long>(mapping::Action::RecallScene) && preset >= config::SCENE_COUNT))
+            {
+                return "usage: map <ch 1-16> <prog 0-127> <action 0-4> [slot] [preset|scene]";
+            }
+            mapping::set(channel - 1, program, {static_cast<mapping::Action>(action), slot, static_cast<uint8_t>(preset)});
+        }
+        else if (!strcmp(argv[0], "log"))
+        {
+            if (argc != 2 || !parseNumber(argv[1], 0, 5, value))
+            {
+                return "usage: log <0-5>";
+            }
+            esp_log_level_set("*", static_cast<esp_log_level_t>(value));
+        }
+        else
+        {
+            return "unknown command, try help";
+        }
+        return nullptr;
+    }
+
+#ifdef CONFIG_IDF_TARGET_LINUX
+    static bool readByte(uint8_t &byte)
+    {
+        pollfd input = {STDIN_FILENO, POLLIN, 0};
+        return poll(&input, 1, STDIN_POLL_MS) > 0 && read(STDIN_FILENO, &byte, 1) == 1;
+    }
+#else
+    static bool readByte(uint8_t &byte)
+    {
+        return uart_read_bytes(UART_PORT_NUM, &byte, 1, portMAX_DELAY) == 1;
+    }
+#endif
+
+    static void console_task(void *arg)
+    {
+        auto tonex = static_cast<Tonex *>(arg);
+        size_t length = 0;
+        while (1)
+        {
+            uint8_t byte;
+            if (!readByte(byte))
+            {
+                continue;
+            }
+            if (byte != '\n' && byte != '\r')
+            {
+                if (length < sizeof(line) - 1)
+                {
+                    line[length++] = byte;
+                }
+                continue;
+            }
+            line[length] = 0;
+            length = 0;
+
+            int argc = 0;
+            char *argv[MAX_ARGS];
+            char *save;
+            for (char *token = strtok_r(line, " \t", &save); token && argc < MAX_ARGS; token = strtok_r(nullptr, " \t", &save))
+            {
+                argv[argc++] = token;
+            }
+            if (!argc)
+            {
+                continue;
+            }
+            auto error = execute(tonex, argc, argv);
+            if (error)
+            {
+                printf("ERR %s\n", error);
+            }
+            else
+            {
+                printf("OK\n");
+            }
+            fflush(stdout);
+        }
+    }
+
+    void printLine(bool toConsole, const char *tag, const char *format, ...)
+    {
+        char text[config::CONSOLE_LINE_SIZE];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        if (toConsole)
+        {
+            printf("%s\n", text);
+        }
+        else
+        {
+            ESP_LOGI(tag, "%s", text);
+        }
+    }
+
+    void init(Tonex *tonex)
+    {
+#ifndef CONFIG_IDF_TARGET_LINUX
+        if (!uart_is_driver_installed(UART_PORT_NUM))
+        {
+            ESP_ERROR_CHECK(uart_driver_install(UART_PORT_NUM, config::CONSOLE_LINE_SIZE * 2, 0, 0, NULL, 0));
+        }
+#endif
+        static report::TaskStorage<config::CONSOLE_TASK_STACK> taskStorage;
+        report::createTask(taskStorage, console_task, "console", tonex, config::CONSOLE_TASK_PRIORITY, config::CONSOLE_TASK_CORE);
+    }
+}
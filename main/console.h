@@ -0,0 +1,37 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+class Tonex;
+
+// Line based control and metrics protocol on the console UART. Every command
+// prints its result followed by "OK" or "ERR <reason>". Runs at the lowest
+// application priority on the core not used by the MIDI -> USB path.
+namespace console {
+    void init(Tonex *tonex);
+    // Writes a line of a report as console output, shown whatever the log level,
+    // or as an info log entry under the tag
+    void printLine(bool toConsole, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+}
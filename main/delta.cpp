@@ -0,0 +1,107 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "delta.h"
+#include "hdlc.h"
+#include <algorithm>
+#include <cstring>
+
+namespace delta
+{
+    static bool differs(const uint8_t *base, size_t baseSize, const uint8_t *raw, size_t position)
+    {
+        return position >= baseSize || raw[position] != base[position];
+    }
+
+    uint16_t check(const uint8_t *base, size_t baseSize)
+    {
+        // The size is part of the check, a base cut short is another base
+        return hdlc::calculateCRC(base, baseSize) ^ static_cast<uint16_t>(baseSize);
+    }
+
+    size_t encode(const uint8_t *base, size_t baseSize, const uint8_t *raw, size_t size, uint8_t *out)
+    {
+        uint16_t baseCheck = check(base, baseSize);
+        size_t length = 0;
+        out[length++] = size & 0xFF;
+        out[length++] = (size >> 8) & 0xFF;
+        out[length++] = baseCheck & 0xFF;
+        out[length++] = baseCheck >> 8;
+        for (size_t start = 0; start < size;)
+        {
+            if (!differs(base, baseSize, raw, start))
+            {
+                start++;
+                continue;
+            }
+            size_t end = start + 1;
+            for (size_t next = end; next < size && next < end + RUN_HEADER && next - start < MAX_RUN; next++)
+            {
+                if (differs(base, baseSize, raw, next))
+                {
+                    end = next + 1;
+                }
+            }
+            out[length++] = start & 0xFF;
+            out[length++] = (start >> 8) & 0xFF;
+            out[length++] = end - start;
+            memcpy(out + length, raw + start, end - start);
+            length += end - start;
+            start = end;
+        }
+        return length;
+    }
+
+    bool decode(const uint8_t *base, size_t baseSize, const uint8_t *in, size_t length, uint8_t *raw, size_t capacity, size_t &size)
+    {
+        if (length < HEADER)
+        {
+            return false;
+        }
+        size = in[0] | (in[1] << 8);
+        if (size > capacity || (in[2] | (in[3] << 8)) != check(base, baseSize))
+        {
+            return false;
+        }
+        memset(raw, 0, size);
+        memcpy(raw, base, std::min(size, baseSize));
+        for (size_t index = HEADER; index < length;)
+        {
+            if (index + RUN_HEADER > length)
+            {
+                return false;
+            }
+            size_t offset = in[index] | (in[index + 1] << 8);
+            size_t run = in[index + 2];
+            index += RUN_HEADER;
+            if (offset + run > size || index + run > length)
+            {
+                return false;
+            }
+            memcpy(raw + offset, in + index, run);
+            index += run;
+        }
+        return true;
+    }
+}
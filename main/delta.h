@@ -0,0 +1,52 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Delta encoding of a pedal state against a base state, used to keep scenes
+// small in NVS. Layout: state size (16 bit), check of the base (16 bit), then
+// runs of offset (16 bit), length (8 bit) and the bytes that differ from the
+// base. Runs separated by less than a run header of equal bytes are merged.
+namespace delta {
+    static const size_t HEADER = 4;
+    static const size_t MAX_RUN = 255;
+    static const size_t RUN_HEADER = 3;
+
+    // Largest encoding of a state of the given size
+    constexpr size_t maxSize(size_t size)
+    {
+        return HEADER + size + RUN_HEADER * (size / MAX_RUN + 1);
+    }
+
+    // Identifies the base an encoding was made against
+    uint16_t check(const uint8_t *base, size_t baseSize);
+    // Writes at most maxSize(size) bytes to out and returns their count
+    size_t encode(const uint8_t *base, size_t baseSize, const uint8_t *raw, size_t size, uint8_t *out);
+    // Rebuilds a state of at most capacity bytes. Fails on a malformed encoding
+    // and on one made against another base.
+    bool decode(const uint8_t *base, size_t baseSize, const uint8_t *in, size_t length, uint8_t *raw, size_t capacity, size_t &size);
+}
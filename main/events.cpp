@@ -0,0 +1,139 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "events.h"
+#include <atomic>
+
+namespace events
+{
+    static const int MAX_SUBSCRIBERS = 8;
+
+    struct Subscriber
+    {
+        uint32_t fields;
+        Callback callback;
+        void *arg;
+    };
+
+    static Subscriber subscribers[MAX_SUBSCRIBERS];
+    static std::atomic<int> subscriberCount{0};
+
+    bool subscribe(uint32_t fields, Callback callback, void *arg)
+    {
+        int index = subscriberCount.load();
+        if (index >= MAX_SUBSCRIBERS)
+        {
+            return false;
+        }
+        subscribers[index] = {fields, callback, arg};
+        subscriberCount.store(index + 1, std::memory_order_release);
+        return true;
+    }
+
+    static void dispatch(const Change &change)
+    {
+        int count = subscriberCount.load(std::memory_order_acquire);
+        for (int i = 0; i < count; i++)
+        {
+            if (subscribers[i].fields & mask(change.field))
+            {
+                subscribers[i].callback(change, subscribers[i].arg);
+            }
+        }
+    }
+
+    static void changed(const StateSnapshot &state, Field field, Origin origin, uint32_t time, uint8_t index, uint32_t value)
+    {
+        dispatch({field, origin, time, index, value, 0, {}, &state});
+    }
+
+    static void changed(const StateSnapshot &state, Field field, Origin origin, uint32_t time, float number)
+    {
+        dispatch({field, origin, time, 0, 0, number, {}, &state});
+    }
+
+    void diff(const StateSnapshot &before, const StateSnapshot &after, Origin origin, uint32_t time)
+    {
+        if (!subscriberCount.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        if (before.currentSlot != after.currentSlot)
+        {
+            changed(after, Field::ActiveSlot, origin, time, 0, after.currentSlot);
+        }
+        if (before.slotAPreset != after.slotAPreset)
+        {
+            changed(after, Field::SlotPreset, origin, time, Slot::A, after.slotAPreset);
+        }
+        if (before.slotBPreset != after.slotBPreset)
+        {
+            changed(after, Field::SlotPreset, origin, time, Slot::B, after.slotBPreset);
+        }
+        if (before.slotCPreset != after.slotCPreset)
+        {
+            changed(after, Field::SlotPreset, origin, time, Slot::C, after.slotCPreset);
+        }
+
+        auto &old = before.settings;
+        auto &settings = after.settings;
+        if (old.inputTrim != settings.inputTrim)
+        {
+            changed(after, Field::InputTrim, origin, time, settings.inputTrim);
+        }
+        if (old.cabSimBypass != settings.cabSimBypass)
+        {
+            changed(after, Field::CabSimBypass, origin, time, 0, settings.cabSimBypass);
+        }
+        if (old.tuningMode != settings.tuningMode)
+        {
+            changed(after, Field::TuningMode, origin, time, 0, settings.tuningMode);
+        }
+        if (old.a4Reference != settings.a4Reference)
+        {
+            changed(after, Field::A4Reference, origin, time, 0, settings.a4Reference);
+        }
+        if (old.directMonitoring != settings.directMonitoring)
+        {
+            changed(after, Field::DirectMonitoring, origin, time, 0, settings.directMonitoring);
+        }
+        if (old.tempoSource != settings.tempoSource)
+        {
+            changed(after, Field::TempoSource, origin, time, 0, settings.tempoSource);
+        }
+        if (old.tempo != settings.tempo)
+        {
+            changed(after, Field::Tempo, origin, time, settings.tempo);
+        }
+        for (int preset = 0; preset < PRESET_COUNT; preset++)
+        {
+            auto &a = old.colors[preset];
+            auto &b = settings.colors[preset];
+            if (a.red != b.red || a.green != b.green || a.blue != b.blue)
+            {
+                dispatch({Field::PresetColor, origin, time, static_cast<uint8_t>(preset), 0, 0, b, &after});
+            }
+        }
+    }
+}
@@ -0,0 +1,81 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include "tonex.h"
+
+// Fine-grained state change events. Every published state is compared with the
+// previous one field by field and only the fields that changed are dispatched
+// to the subscribers interested in them.
+namespace events {
+    enum Field : uint8_t
+    {
+        ActiveSlot,
+        SlotPreset,     // index - slot
+        InputTrim,
+        CabSimBypass,
+        TuningMode,
+        A4Reference,
+        DirectMonitoring,
+        TempoSource,
+        Tempo,
+        PresetColor,    // index - preset
+        FIELDS
+    };
+
+    enum class Origin : uint8_t
+    {
+        Pedal,  // StateUpdate received from the pedal
+        Local   // command sent by this controller
+    };
+
+    struct Change
+    {
+        Field field;
+        Origin origin;
+        uint32_t time;  // esp_timer microseconds when the change was received or commanded
+        uint8_t index;
+        uint32_t value;
+        float number;
+        Color color;
+        // Whole state the change is part of, valid during the callback
+        const StateSnapshot *state;
+    };
+
+    typedef void (*Callback)(const Change &change, void *arg);
+
+    constexpr uint32_t mask(Field field)
+    {
+        return 1u << field;
+    }
+
+    // Meant to be called during initialization. Subscribers are called from the
+    // task that published the state, without any lock held. Returns false when
+    // the dispatch table is full.
+    bool subscribe(uint32_t fields, Callback callback, void *arg);
+
+    void diff(const StateSnapshot &before, const StateSnapshot &after, Origin origin, uint32_t time);
+}
@@ -23,6 +23,7 @@
  */
 
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 #include <vector>
@@ -31,64 +32,87 @@
 namespace hdlc {
 
 uint16_t calculateCRC(const std::vector<uint8_t> &data) {
-    uint16_t crc = 0xFFFF;
-    for (uint8_t byte : data) {
-        crc ^= byte;
-        for (int i = 0; i < 8; ++i) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ 0x8408;  // 0x8408 is the reversed polynomial x^16 + x^12 + x^5 + 1
-            } else {
-                crc = crc >> 1;
-            }
-        }
+    return calculateCRC(data.data(), data.size());
+}
+
+// Word-at-a-time (SWAR) search for the first flag or escape byte.
+// Returns size when the whole range can be copied as is.
+static size_t findSpecial(const uint8_t *data, size_t size) {
+  typedef uintptr_t word_t;
+  const word_t ones = ~word_t(0) / 0xFF;
+  const word_t highs = ones * 0x80;
+  const word_t flags = ones * FLAG;
+  const word_t escapes = ones * ESCAPE;
+
+  size_t i = 0;
+  for (; i + sizeof(word_t) <= size; i += sizeof(word_t)) {
+    word_t word;
+    memcpy(&word, data + i, sizeof(word));
+    word_t x = word ^ flags;
+    word_t y = word ^ escapes;
+    if (((x - ones) & ~x & highs) | ((y - ones) & ~y & highs)) {
+      break;
+    }
+  }
+  for (; i < size; ++i) {
+    if (data[i] == FLAG || data[i] == ESCAPE) {
+      break;
     }
-    return ~crc;
+  }
+  return i;
 }
 
-void addByteWithStuffing(std::vector<uint8_t> &output, uint8_t byte) {
-  if (byte == 0x7E || byte == 0x7D) {
-    output.push_back(0x7D);
-    output.push_back(byte ^ 0x20);
-  } else {
-    output.push_back(byte);
+static void addWithStuffing(std::vector<uint8_t> &output, const uint8_t *data, size_t size) {
+  size_t i = 0;
+  while (i < size) {
+    size_t run = findSpecial(data + i, size - i);
+    output.insert(output.end(), data + i, data + i + run);
+    i += run;
+    if (i < size) {
+      output.push_back(ESCAPE);
+      output.push_back(data[i] ^ 0x20);
+      ++i;
+    }
   }
 }
 
 std::vector<uint8_t> addFraming(const std::vector<uint8_t> &input) {
   std::vector<uint8_t> output;
-  output.reserve(input.size() * 2 + 4);
-  output.push_back(0x7E); // Start flag
+  output.reserve(input.size() * 2 + 6);
+  output.push_back(FLAG); // Start flag
 
-  for (uint8_t byte : input) {
-    addByteWithStuffing(output, byte);
-  }
+  addWithStuffing(output, input.data(), input.size());
 
   uint16_t crc = calculateCRC(input);
-  addByteWithStuffing(output, crc & 0xFF);
-  addByteWithStuffing(output, crc >> 8);
+  const uint8_t crcBytes[] = {static_cast<uint8_t>(crc & 0xFF), static_cast<uint8_t>(crc >> 8)};
+  addWithStuffing(output, crcBytes, sizeof(crcBytes));
 
-  output.push_back(0x7E); // End flag
+  output.push_back(FLAG); // End flag
   return output;
 }
 
 std::tuple<Status, std::vector<uint8_t>> removeFraming(const std::vector<uint8_t> &input) {
-  if (input.size() < 4 || input.front() != 0x7E || input.back() != 0x7E) {
+  if (input.size() < 4 || input.front() != FLAG || input.back() != FLAG) {
     return {Status::InvalidFrame, {}};
   }
 
   std::vector<uint8_t> output;
-  for (size_t i = 1; i < input.size() - 1; ++i) {
-    if (input[i] == 0x7D) {
-      if (i + 1 >= input.size() - 1) {
-        return {Status::InvalidEscapeSequence, {}};
-      }
-      output.push_back(input[i + 1] ^ 0x20);
-      ++i;
-    } else if (input[i] == 0x7E) {
+  output.reserve(input.size());
+  const uint8_t *data = input.data();
+  size_t end = input.size() - 1;
+  size_t i = 1;
+  while (i < end) {
+    size_t run = findSpecial(data + i, end - i);
+    output.insert(output.end(), data + i, data + i + run);
+    i += run;
+    if (i >= end || data[i] == FLAG) {
       break;
-    } else {
-      output.push_back(input[i]);
     }
+    if (i + 1 >= end) {
+      return {Status::InvalidEscapeSequence, {}};
+    }
+    output.push_back(data[i + 1] ^ 0x20);
+    i += 2;
   }
 
   if (output.size() < 2) {
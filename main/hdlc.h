@@ -24,9 +24,12 @@
 
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <stdexcept>
+#include <tuple>
 #include <vector>
 
 namespace hdlc {
@@ -38,6 +41,56 @@ enum Status {
     CRCMismatch
 };
 
+constexpr uint8_t FLAG = 0x7E;
+constexpr uint8_t ESCAPE = 0x7D;
+
+constexpr uint16_t calculateCRC(const uint8_t *data, size_t size) {
+  uint16_t crc = 0xFFFF;
+  for (size_t index = 0; index < size; ++index) {
+    crc ^= data[index];
+    for (int i = 0; i < 8; ++i) {
+      if (crc & 1) {
+        crc = (crc >> 1) ^ 0x8408;  // 0x8408 is the reversed polynomial x^16 + x^12 + x^5 + 1
+      } else {
+        crc = crc >> 1;
+      }
+    }
+  }
+  return ~crc;
+}
+
+// Frame built at compile time. Capacity covers the worst case where every
+// payload and CRC byte needs escaping, size is the actual length.
+template <size_t N>
+struct StaticFrame {
+  std::array<uint8_t, 2 * (N + 2) + 2> data{};
+  size_t size = 0;
+};
+
+template <size_t N>
+constexpr StaticFrame<N> addFraming(const std::array<uint8_t, N> &input) {
+  StaticFrame<N> frame;
+  uint16_t crc = calculateCRC(input.data(), N);
+  std::array<uint8_t, N + 2> body{};
+  for (size_t i = 0; i < N; ++i) {
+    body[i] = input[i];
+  }
+  body[N] = crc & 0xFF;
+  body[N + 1] = crc >> 8;
+
+  frame.data[frame.size++] = FLAG;
+  for (uint8_t byte : body) {
+    if (byte == FLAG || byte == ESCAPE) {
+      frame.data[frame.size++] = ESCAPE;
+      frame.data[frame.size++] = byte ^ 0x20;
+    } else {
+      frame.data[frame.size++] = byte;
+    }
+  }
+  frame.data[frame.size++] = FLAG;
+  return frame;
+}
+
 std::vector<uint8_t> addFraming(const std::vector<uint8_t> &input);
 
 std::tuple<Status, std::vector<uint8_t>> removeFraming(const std::vector<uint8_t> &input);
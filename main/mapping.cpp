@@ -0,0 +1,244 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "mapping.h"
+#include <atomic>
+#include "esp_log.h"
+#include "nvs.h"
+#include "report.h"
+#include "config.h"
+
+namespace mapping
+{
+    static const char *TAG = "TONEX_CONTROLLER_MAPPING";
+    static const char *NVS_NAMESPACE = "tonex";
+    static const char *NVS_KEY = "mapping";
+
+    // Default mapping reproduces the original behaviour: on channel 2 program 1
+    // activates slot B, any other program activates slot A
+    static const uint8_t DEFAULT_CHANNEL = 2;
+
+    // SysEx: F0 7D <command> ... F7. 0x7D is the non-commercial manufacturer ID
+    static const uint8_t SYSEX_ID = 0x7D;
+    enum SysexCommand : uint8_t
+    {
+        SetEntry = 0x01,     // channel program action slot preset
+        SetChannel = 0x02,   // channel, then action slot preset for all 128 programs
+        Save = 0x03,
+        Reset = 0x04
+    };
+
+    // Entry packed into 16 bits: preset (7) | slot (2) | action (4)
+    static std::atomic<uint16_t> table[CHANNELS * PROGRAMS];
+    // The table is read from and written to NVS as is, without a staging copy
+    static_assert(sizeof(table) == CHANNELS * PROGRAMS * sizeof(uint16_t) && std::atomic<uint16_t>::is_always_lock_free,
+                  "mapping entries must be plain 16-bit words");
+
+    static uint16_t pack(const Entry &entry)
+    {
+        return (entry.preset & 0x7F) | ((static_cast<uint16_t>(entry.slot) & 0x03) << 7) | ((static_cast<uint16_t>(entry.action) & 0x0F) << 9);
+    }
+
+    static Entry unpack(uint16_t packed)
+    {
+        return {static_cast<Action>((packed >> 9) & 0x0F), static_cast<Slot>((packed >> 7) & 0x03), static_cast<uint8_t>(packed & 0x7F)};
+    }
+
+    static bool valid(const Entry &entry)
+    {
+        return entry.action <= Action::RecallScene && entry.slot <= Slot::C &&
+               entry.preset < (entry.action == Action::RecallScene ? config::SCENE_COUNT : PRESET_COUNT);
+    }
+
+    Entry lookup(uint8_t channel, uint8_t program)
+    {
+        return unpack(table[(channel & 0x0F) * PROGRAMS + (program & 0x7F)].load(std::memory_order_relaxed));
+    }
+
+    void set(uint8_t channel, uint8_t program, const Entry &entry)
+    {
+        table[(channel & 0x0F) * PROGRAMS + (program & 0x7F)].store(pack(entry), std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        for (int channel = 0; channel < CHANNELS; channel++)
+        {
+            for (int program = 0; program < PROGRAMS; program++)
+            {
+                Entry entry = {Action::None, Slot::A, 0};
+                if (channel == DEFAULT_CHANNEL)
+                {
+                    entry = {Action::SetSlot, program == 1 ? Slot::B : Slot::A, 0};
+                }
+                set(channel, program, entry);
+            }
+        }
+    }
+
+    // Moves all entries of a channel to another one, e.g. when the controller changes its MIDI channel
+    void moveChannel(uint8_t from, uint8_t to)
+    {
+        if (from == to || from >= CHANNELS || to >= CHANNELS)
+        {
+            return;
+        }
+        for (int program = 0; program < PROGRAMS; program++)
+        {
+            set(to, program, lookup(from, program));
+            set(from, program, {Action::None, Slot::A, 0});
+        }
+    }
+
+    bool findProgram(uint8_t channel, Slot slot, uint8_t preset, uint8_t &program)
+    {
+        // A switch silently entry names the preset itself, so it wins over any set slot entry
+        int slotProgram = -1;
+        for (int candidate = 0; candidate < PROGRAMS; candidate++)
+        {
+            auto entry = lookup(channel, candidate);
+            if (entry.action == Action::SwitchSilently && entry.preset == preset)
+            {
+                program = candidate;
+                return true;
+            }
+            if (slotProgram < 0 && entry.action == Action::SetSlot && entry.slot == slot)
+            {
+                slotProgram = candidate;
+            }
+        }
+        if (slotProgram < 0)
+        {
+            return false;
+        }
+        program = slotProgram;
+        return true;
+    }
+
+    esp_err_t save()
+    {
+        nvs_handle_t handle;
+        esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        err = nvs_set_blob(handle, NVS_KEY, table, sizeof(table));
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+        ESP_LOGI(TAG, "Mapping saved: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    void init()
+    {
+        report::addBuffer("mapping", sizeof(table));
+        // Runs before the MIDI and console tasks start, nothing reads the table yet
+        size_t size = sizeof(table);
+        nvs_handle_t handle;
+        esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+        if (err == ESP_OK)
+        {
+            err = nvs_get_blob(handle, NVS_KEY, table, &size);
+            nvs_close(handle);
+        }
+        if (err != ESP_OK || size != sizeof(table))
+        {
+            ESP_LOGI(TAG, "No stored mapping, using defaults");
+            reset();
+            return;
+        }
+        // Entries written by older firmware or damaged in flash must not reach dispatch
+        int invalid = 0;
+        for (int i = 0; i < CHANNELS * PROGRAMS; i++)
+        {
+            if (!valid(unpack(table[i].load(std::memory_order_relaxed))))
+            {
+                table[i].store(pack({Action::None, Slot::A, 0}), std::memory_order_relaxed);
+                invalid++;
+            }
+        }
+        if (invalid)
+        {
+            ESP_LOGW(TAG, "%d invalid mapping entries reset", invalid);
+        }
+        ESP_LOGI(TAG, "Mapping loaded");
+    }
+
+    bool handleSysex(const uint8_t *data, size_t size)
+    {
+        if (size < 2 || data[0] != SYSEX_ID)
+        {
+            return false;
+        }
+        switch (data[1])
+        {
+        case SysexCommand::SetEntry:
+        {
+            if (size != 7)
+            {
+                break;
+            }
+            Entry entry = {static_cast<Action>(data[4]), static_cast<Slot>(data[5]), data[6]};
+            if (data[2] >= CHANNELS || !valid(entry))
+            {
+                break;
+            }
+            set(data[2], data[3], entry);
+            return true;
+        }
+        case SysexCommand::SetChannel:
+        {
+            if (size != 3 + PROGRAMS * 3 || data[2] >= CHANNELS)
+            {
+                break;
+            }
+            for (int program = 0; program < PROGRAMS; program++)
+            {
+                auto item = data + 3 + program * 3;
+                Entry entry = {static_cast<Action>(item[0]), static_cast<Slot>(item[1]), item[2]};
+                if (!valid(entry))
+                {
+                    entry = {Action::None, Slot::A, 0};
+                }
+                set(data[2], program, entry);
+            }
+            ESP_LOGI(TAG, "Mapping for channel %d replaced", data[2]);
+            return true;
+        }
+        case SysexCommand::Save:
+            save();
+            return true;
+        case SysexCommand::Reset:
+            reset();
+            ESP_LOGI(TAG, "Mapping reset to defaults");
+            return true;
+        }
+        ESP_LOGW(TAG, "Invalid mapping SysEx command");
+        return true;
+    }
+}
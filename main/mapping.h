@@ -0,0 +1,67 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "esp_err.h"
+#include "tonex.h"
+
+// Program change mapping. Every (channel, program) pair has its own entry in a
+// flat table, so dispatch is a single indexed lookup. The table is kept in NVS
+// and can be replaced at runtime.
+namespace mapping {
+    static const int CHANNELS = 16;
+    static const int PROGRAMS = 128;
+
+    enum class Action : uint8_t
+    {
+        None = 0,
+        SetSlot,        // activate slot
+        LoadPreset,     // load preset into slot without activating it
+        SwitchSilently, // load preset into the inactive slot and activate it
+        RecallScene     // restore the scene stored under the preset number
+    };
+
+    struct Entry
+    {
+        Action action;
+        Slot slot;
+        uint8_t preset;
+    };
+
+    void init();
+    Entry lookup(uint8_t channel, uint8_t program);
+    void set(uint8_t channel, uint8_t program, const Entry &entry);
+    void reset();
+    void moveChannel(uint8_t from, uint8_t to);
+    // Finds a program on the channel that leads to the given slot and preset being active,
+    // preferring one that selects the preset over one that only selects the slot
+    bool findProgram(uint8_t channel, Slot slot, uint8_t preset, uint8_t &program);
+    esp_err_t save();
+
+    // Handles SysEx body (without 0xF0 and 0xF7). Returns false if it is not addressed to us.
+    bool handleSysex(const uint8_t *data, size_t size);
+}
@@ -0,0 +1,99 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "metrics.h"
+#include <inttypes.h>
+#include <cstdio>
+
+namespace metrics
+{
+    static const int MAX_COUNTERS = 32;
+    static const int MAX_HISTOGRAMS = 16;
+
+    // Plain arrays are zero-initialized before any constructor runs
+    static Counter *counters[MAX_COUNTERS];
+    static int counterCount;
+    static Histogram *histograms[MAX_HISTOGRAMS];
+    static int histogramCount;
+
+    Counter::Counter(const char *name) : name(name)
+    {
+        if (counterCount < MAX_COUNTERS)
+        {
+            counters[counterCount++] = this;
+        }
+    }
+
+    Histogram::Histogram(const char *name, const char *unit) : name(name), unit(unit)
+    {
+        if (histogramCount < MAX_HISTOGRAMS)
+        {
+            histograms[histogramCount++] = this;
+        }
+    }
+
+    void Histogram::record(uint32_t value)
+    {
+        int bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+        if (bucket >= BUCKETS)
+        {
+            bucket = BUCKETS - 1;
+        }
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        auto current = max.load(std::memory_order_relaxed);
+        while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    uint32_t Histogram::getMean() const
+    {
+        auto samples = getCount();
+        return samples ? static_cast<uint32_t>(sum.load(std::memory_order_relaxed) / samples) : 0;
+    }
+
+    void print()
+    {
+        for (int i = 0; i < counterCount; i++)
+        {
+            printf("%s: %" PRIu32 "\n", counters[i]->getName(), counters[i]->get());
+        }
+        for (int i = 0; i < histogramCount; i++)
+        {
+            auto histogram = histograms[i];
+            printf("%s: count %" PRIu32 ", mean %" PRIu32 " %s, max %" PRIu32 " %s\n", histogram->getName(),
+                   histogram->getCount(), histogram->getMean(), histogram->getUnit(), histogram->getMax(), histogram->getUnit());
+            for (int bucket = 0; bucket < Histogram::BUCKETS; bucket++)
+            {
+                auto samples = histogram->getBucket(bucket);
+                if (samples)
+                {
+                    printf("  < %" PRIu32 ": %" PRIu32 "\n", static_cast<uint32_t>(1u << bucket), samples);
+                }
+            }
+        }
+    }
+}
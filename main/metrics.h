@@ -0,0 +1,73 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free counters and histograms. Instances register themselves by name at
+// static initialization so they can be printed from one place.
+namespace metrics {
+    class Counter
+    {
+    private:
+        const char *name;
+        std::atomic<uint32_t> value{0};
+
+    public:
+        explicit Counter(const char *name);
+        void increment(uint32_t by = 1) { value.fetch_add(by, std::memory_order_relaxed); }
+        uint32_t get() const { return value.load(std::memory_order_relaxed); }
+        const char *getName() const { return name; }
+    };
+
+    // Bucket 0 counts zeros, bucket n counts values in [2^(n-1), 2^n)
+    class Histogram
+    {
+    public:
+        static const int BUCKETS = 24;
+
+    private:
+        const char *name;
+        const char *unit;
+        std::atomic<uint32_t> buckets[BUCKETS] = {};
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> max{0};
+        std::atomic<uint64_t> sum{0};
+
+    public:
+        Histogram(const char *name, const char *unit);
+        void record(uint32_t value);
+        uint32_t getCount() const { return count.load(std::memory_order_relaxed); }
+        uint32_t getMax() const { return max.load(std::memory_order_relaxed); }
+        uint32_t getMean() const;
+        uint32_t getBucket(int bucket) const { return buckets[bucket].load(std::memory_order_relaxed); }
+        const char *getName() const { return name; }
+        const char *getUnit() const { return unit; }
+    };
+
+    // Writes all metrics to the console
+    void print();
+}
@@ -37,75 +37,182 @@
 #include "hdlc.h"
 #include "midi.h"
 #include "tonex.h"
+#include "trace.h"
+#include "mapping.h"
+#include "scenes.h"
+#include "preload.h"
+#include "config.h"
+#include "report.h"
+#include "boot.h"
+#include "events.h"
+#include "metrics.h"
+#include "esp_timer.h"
 
 namespace midi
 {
     static const uart_port_t UART_PORT_NUM = UART_NUM_1;
-    static const uint8_t MIDI_CHANNEL = 2;
-    static const int BUF_SIZE = 128;
+    static const size_t SYSEX_MAX_SIZE = 3 + mapping::PROGRAMS * 3;
     static const char *TAG = "TONEX_CONTROLLER_MIDI";
 
-    static std::vector<ProgramChange> parseProgramChanges(const uint8_t *buffer, size_t bufferSize);
+    // SysEx can span several UART reads
+    static uint8_t sysex[SYSEX_MAX_SIZE];
+    static size_t sysexSize = 0;
+    static bool inSysex = false;
+    static uint8_t data[config::MIDI_UART_BUFFER_SIZE];
 
-    void midi_receiver(void *arg)
+    static metrics::Counter outMessages("midi.out_messages");
+    static metrics::Counter outDropped("midi.out_dropped");
+    static metrics::Histogram outLatency("midi.out_latency", "us");
+
+    static std::vector<ProgramChange> parseMessages(const uint8_t *buffer, size_t bufferSize);
+
+    static void dispatch(Tonex *tonex, const mapping::Entry &entry)
     {
-        auto tonex = static_cast<Tonex *>(arg);
-        /* Configure parameters of an UART driver,
-         * communication pins and install the driver */
-        uart_config_t uart_config = {
-            .baud_rate = 31250,
-            .data_bits = UART_DATA_8_BITS,
-            .parity = UART_PARITY_DISABLE,
-            .stop_bits = UART_STOP_BITS_1,
-            .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-            .source_clk = UART_SCLK_DEFAULT,
-        };
-        int intr_alloc_flags = 0;
+        switch (entry.action)
+        {
+        case mapping::Action::SetSlot:
+            tonex->setSlot(entry.slot);
+            break;
+        case mapping::Action::LoadPreset:
+            tonex->changePreset(entry.slot, entry.preset);
+            break;
+        case mapping::Action::SwitchSilently:
+            tonex->switchSilently(entry.preset);
+            break;
+        case mapping::Action::RecallScene:
+            scenes::recall(entry.preset, tonex);
+            break;
+        case mapping::Action::None:
+            break;
+        }
+    }
 
-        ESP_ERROR_CHECK(uart_driver_install(UART_PORT_NUM, BUF_SIZE * 2, 0, 0, NULL, intr_alloc_flags));
-        ESP_ERROR_CHECK(uart_param_config(UART_PORT_NUM, &uart_config));
-        ESP_ERROR_CHECK(uart_set_pin(UART_PORT_NUM, 4, 5, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+#ifdef CONFIG_TONEX_MIDI_OUT
+    static const uint8_t OUT_CHANNEL = CONFIG_TONEX_MIDI_OUT_CHANNEL - 1;
+
+    // Queues a message into the UART TX ring. Never blocks, drops the message if the ring is full.
+    static void send(const uint8_t *message, size_t size, uint32_t since)
+    {
+        size_t free = 0;
+        uart_get_tx_buffer_free_size(UART_PORT_NUM, &free);
+        if (free < size)
+        {
+            outDropped.increment();
+            return;
+        }
+        uart_write_bytes(UART_PORT_NUM, message, size);
+        outMessages.increment();
+        outLatency.record(static_cast<uint32_t>(esp_timer_get_time()) - since);
+    }
 
-        auto data = new uint8_t[BUF_SIZE];
+    // Mirrors slot and preset changes made on the pedal itself, so the MIDI
+    // controller can follow. Our own commands are already in the local state
+    // when their echo arrives, so they produce no pedal originated change.
+    static void onStateChange(const events::Change &change, void *arg)
+    {
+        static int lastProgram = -1;
+        static int lastSlot = -1;
+        static int lastPreset = -1;
 
+        if (change.origin != events::Origin::Pedal)
+        {
+            return;
+        }
+        // The state carried by the event, a later StateUpdate may already be published
+        auto &state = *change.state;
+        if (change.field == events::Field::SlotPreset && change.index != state.currentSlot)
+        {
+            return;
+        }
+        uint8_t preset = state.currentSlot == Slot::A ? state.slotAPreset : state.currentSlot == Slot::B ? state.slotBPreset : state.slotCPreset;
+
+        // Program Change when the mapping has a program for the new state. A set slot
+        // entry does not tell the preset, so a preset change then goes out as Control
+        // Changes. Each path resets the duplicate tracking of the other one, the
+        // controller state is whatever was sent last.
+        uint8_t program;
+        bool mapped = mapping::findProgram(OUT_CHANNEL, state.currentSlot, preset, program);
+        bool mapsPreset = mapped && mapping::lookup(OUT_CHANNEL, program).action == mapping::Action::SwitchSilently;
+        if (mapped && (change.field == events::Field::ActiveSlot || mapsPreset))
+        {
+            if (program != lastProgram)
+            {
+                lastProgram = program;
+                lastSlot = -1;
+                lastPreset = -1;
+                const uint8_t message[] = {static_cast<uint8_t>(0xC0 | OUT_CHANNEL), program};
+                send(message, sizeof(message), change.time);
+            }
+            return;
+        }
+        lastProgram = -1;
+        if (state.currentSlot != lastSlot)
+        {
+            lastSlot = state.currentSlot;
+            const uint8_t message[] = {static_cast<uint8_t>(0xB0 | OUT_CHANNEL), CONFIG_TONEX_MIDI_OUT_SLOT_CC, static_cast<uint8_t>(state.currentSlot)};
+            send(message, sizeof(message), change.time);
+        }
+        if (preset != lastPreset)
+        {
+            lastPreset = preset;
+            const uint8_t message[] = {static_cast<uint8_t>(0xB0 | OUT_CHANNEL), CONFIG_TONEX_MIDI_OUT_PRESET_CC, preset};
+            send(message, sizeof(message), change.time);
+        }
+    }
+#endif
+
+    void midi_receiver(void *arg)
+    {
+        auto tonex = static_cast<Tonex *>(arg);
         while (1)
         {
-            int len = uart_read_bytes(UART_PORT_NUM, data, (BUF_SIZE - 1), pdMS_TO_TICKS(20));
+            int len = uart_read_bytes(UART_PORT_NUM, data, sizeof(data), pdMS_TO_TICKS(20));
             if (len)
             {
                 // ESP_LOG_BUFFER_HEXDUMP(TAG, data, len, ESP_LOG_INFO);
                 // ESP_LOGI(TAG, "Received %d bytes from UART", len);
-                auto programChanges = parseProgramChanges(data, len);
+                auto programChanges = parseMessages(data, len);
 
                 for (auto programChange : programChanges)
                 {
-                    if (programChange.channel != MIDI_CHANNEL)
-                    {
-                        continue;
-                    }
-                    auto slotNumber = programChange.programNumber == 1 ? Slot::B : Slot::A;
-                    tonex->setSlot(slotNumber);
-                    // if (programChange.programNumber < 20)
-                    // {
-                    //     tonex->switchSilently(programChange.programNumber);
-                    // }
-                    // else 
-                    // {
-                    //     ESP_LOGW(TAG, "Invalid program number: %d", programChange.programNumber);
-                    // }
+                    preload::onProgramChange(programChange.channel, programChange.programNumber);
+                    dispatch(tonex, mapping::lookup(programChange.channel, programChange.programNumber));
                 }
                 vTaskDelay(pdMS_TO_TICKS(10));
             }
         }
-        delete data;
     }
 
     void init(Tonex *tonex)
     {
-        xTaskCreatePinnedToCore(midi_receiver, "midi_receiver", 4096, tonex, 10, NULL, 0);
+        /* Configure parameters of an UART driver,
+         * communication pins and install the driver */
+        uart_config_t uart_config = {
+            .baud_rate = 31250,
+            .data_bits = UART_DATA_8_BITS,
+            .parity = UART_PARITY_DISABLE,
+            .stop_bits = UART_STOP_BITS_1,
+            .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+            .source_clk = UART_SCLK_DEFAULT,
+        };
+        int intr_alloc_flags = 0;
+
+        ESP_ERROR_CHECK(uart_driver_install(UART_PORT_NUM, config::MIDI_UART_BUFFER_SIZE * 2, config::MIDI_TX_BUFFER_SIZE, 0, NULL, intr_alloc_flags));
+        ESP_ERROR_CHECK(uart_param_config(UART_PORT_NUM, &uart_config));
+        ESP_ERROR_CHECK(uart_set_pin(UART_PORT_NUM, 4, 5, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+        boot::mark(boot::MidiReady);
+
+#ifdef CONFIG_TONEX_MIDI_OUT
+        events::subscribe(events::mask(events::Field::ActiveSlot) | events::mask(events::Field::SlotPreset), onStateChange, tonex);
+#endif
+
+        static report::TaskStorage<config::MIDI_TASK_STACK> taskStorage;
+        report::createTask(taskStorage, midi_receiver, "midi_receiver", tonex, config::MIDI_TASK_PRIORITY, config::MIDI_TASK_CORE);
+        report::addBuffer("midi", sizeof(data) + sizeof(sysex));
     }
 
-    static std::vector<ProgramChange> parseProgramChanges(const uint8_t *buffer, size_t bufferSize)
+    // Returns program changes. SysEx messages are collected and handed over to the mapping.
+    static std::vector<ProgramChange> parseMessages(const uint8_t *buffer, size_t bufferSize)
     {
         std::vector<ProgramChange> programChanges;
 
@@ -117,6 +224,32 @@ namespace midi
                 continue;
             }
 
+            if (inSysex)
+            {
+                if (!(buffer[i] & 0x80))
+                {
+                    if (sysexSize < SYSEX_MAX_SIZE)
+                    {
+                        sysex[sysexSize++] = buffer[i];
+                    }
+                    continue;
+                }
+                inSysex = false;
+                if (buffer[i] == 0xF7)
+                {
+                    mapping::handleSysex(sysex, sysexSize);
+                    continue;
+                }
+                // Any other status byte aborts the SysEx and is handled below
+            }
+
+            if (buffer[i] == 0xF0)
+            {
+                inSysex = true;
+                sysexSize = 0;
+                continue;
+            }
+
             // Check if this byte is a status byte for Program Change
             if ((buffer[i] & 0xF0) == 0xC0)
             {
@@ -127,7 +260,7 @@ namespace midi
                 if (i + 1 < bufferSize)
                 {
                     uint8_t programNumber = buffer[i + 1];
-                    ESP_LOGI(TAG, "Received program change [channel: %d, program: %d]", channel, programNumber);
+                    TRACE(Midi, Info, "Received program change [channel: %d, program: %d]", channel, programNumber);
                     programChanges.push_back({channel, programNumber});
 
                     // Skip the data byte
@@ -135,7 +268,7 @@ namespace midi
                 }
                 else
                 {
-                    ESP_LOGW(TAG, "Warning: Incomplete Program Change message at end of buffer");
+                    TRACE(Midi, Warn, "Incomplete Program Change message at end of buffer");
                     break;
                 }
             }
@@ -0,0 +1,95 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "preload.h"
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mapping.h"
+#include "metrics.h"
+#include "tonex.h"
+#include "config.h"
+#include "report.h"
+
+namespace preload
+{
+    // Quiet time after a program change before the inactive slot is touched
+    static const TickType_t IDLE_WINDOW = pdMS_TO_TICKS(300);
+
+    static TaskHandle_t task;
+    static std::atomic<uint8_t> lastChannel{0};
+    static std::atomic<uint8_t> lastProgram{0};
+    // Bumped by every program change, a preload decided before it is dropped
+    static std::atomic<uint32_t> generation{0};
+    static metrics::Counter preloads("preload.loads");
+
+    static void preload_task(void *arg)
+    {
+        auto tonex = static_cast<Tonex *>(arg);
+        while (1)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            // Wait until program changes stop arriving
+            while (ulTaskNotifyTake(pdTRUE, IDLE_WINDOW))
+            {
+            }
+            uint32_t decidedAt = generation.load();
+
+            uint8_t channel = lastChannel.load(std::memory_order_relaxed);
+            uint8_t program = lastProgram.load(std::memory_order_relaxed);
+            if (program + 1 >= mapping::PROGRAMS)
+            {
+                continue;
+            }
+            auto next = mapping::lookup(channel, program + 1);
+            if (next.action != mapping::Action::SwitchSilently)
+            {
+                continue;
+            }
+
+            if (tonex->preload(next.preset, [decidedAt] { return generation.load() == decidedAt; }))
+            {
+                preloads.increment();
+            }
+        }
+    }
+
+    void onProgramChange(uint8_t channel, uint8_t program)
+    {
+        generation++;
+        if (mapping::lookup(channel, program).action != mapping::Action::SwitchSilently)
+        {
+            return;
+        }
+        lastChannel.store(channel, std::memory_order_relaxed);
+        lastProgram.store(program, std::memory_order_relaxed);
+        xTaskNotifyGive(task);
+    }
+
+    void init(Tonex *tonex)
+    {
+        static report::TaskStorage<config::PRELOAD_TASK_STACK> taskStorage;
+        task = report::createTask(taskStorage, preload_task, "preload", tonex, config::PRELOAD_TASK_PRIORITY, config::PRELOAD_TASK_CORE);
+    }
+}
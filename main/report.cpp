@@ -0,0 +1,110 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "report.h"
+#include <inttypes.h>
+#include "sdkconfig.h"
+#ifdef CONFIG_IDF_TARGET_LINUX
+#include <malloc.h>
+#else
+#include "esp_heap_caps.h"
+#endif
+#include "esp_log.h"
+#include "console.h"
+
+namespace report
+{
+    static const char *TAG = "TONEX_CONTROLLER_REPORT";
+    static const int MAX_TASKS = 12;
+    static const int MAX_BUFFERS = 12;
+
+    struct Task
+    {
+        TaskHandle_t handle;
+        uint32_t stackSize;
+    };
+    struct Buffer
+    {
+        const char *name;
+        size_t size;
+    };
+
+    static Task tasks[MAX_TASKS];
+    static int taskCount;
+    static Buffer buffers[MAX_BUFFERS];
+    static int bufferCount;
+
+    void addTask(TaskHandle_t task, uint32_t stackSize)
+    {
+        if (taskCount < MAX_TASKS)
+        {
+            tasks[taskCount++] = {task, stackSize};
+        }
+    }
+
+    void addBuffer(const char *name, size_t size)
+    {
+        if (bufferCount < MAX_BUFFERS)
+        {
+            buffers[bufferCount++] = {name, size};
+        }
+    }
+
+    static void summary(bool toConsole)
+    {
+        size_t staticTotal = 0;
+        for (int i = 0; i < taskCount; i++)
+        {
+            // On ESP-IDF stack sizes and high-water marks are in bytes
+            auto unused = uxTaskGetStackHighWaterMark(tasks[i].handle);
+            console::printLine(toConsole, TAG, "Task %-16s stack %5" PRIu32 " used %5" PRIu32 " free %5" PRIu32, pcTaskGetName(tasks[i].handle),
+                               tasks[i].stackSize, tasks[i].stackSize - static_cast<uint32_t>(unused), static_cast<uint32_t>(unused));
+            staticTotal += tasks[i].stackSize;
+        }
+        for (int i = 0; i < bufferCount; i++)
+        {
+            console::printLine(toConsole, TAG, "Buffer %-14s %5u", buffers[i].name, static_cast<unsigned>(buffers[i].size));
+            staticTotal += buffers[i].size;
+        }
+        console::printLine(toConsole, TAG, "Static total: %u bytes", static_cast<unsigned>(staticTotal));
+#ifdef CONFIG_IDF_TARGET_LINUX
+        // Process heap of the host, there is no fixed total
+        auto heap = mallinfo2();
+        console::printLine(toConsole, TAG, "Heap: in use %u, free in arena %u", static_cast<unsigned>(heap.uordblks), static_cast<unsigned>(heap.fordblks));
+#else
+        console::printLine(toConsole, TAG, "Heap: total %u, free %u, minimum free %u", static_cast<unsigned>(heap_caps_get_total_size(MALLOC_CAP_DEFAULT)),
+                           static_cast<unsigned>(heap_caps_get_free_size(MALLOC_CAP_DEFAULT)), static_cast<unsigned>(heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT)));
+#endif
+    }
+
+    void log()
+    {
+        summary(false);
+    }
+
+    void print()
+    {
+        summary(true);
+    }
+}
@@ -0,0 +1,59 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Memory footprint report. Tasks and big static buffers register here when
+// they are created; the report lists stack high-water marks and static/heap usage.
+namespace report {
+    void addTask(TaskHandle_t task, uint32_t stackSize);
+    void addBuffer(const char *name, size_t size);
+    // Report through the log, for diagnostics
+    void log();
+    // Report on the console
+    void print();
+
+    template <uint32_t StackSize>
+    struct TaskStorage
+    {
+        StackType_t stack[StackSize];
+        StaticTask_t task;
+    };
+
+    // Creates a task on a static stack and registers it
+    template <uint32_t StackSize>
+    TaskHandle_t createTask(TaskStorage<StackSize> &storage, TaskFunction_t function, const char *name, void *arg, UBaseType_t priority, BaseType_t core)
+    {
+        auto handle = xTaskCreateStaticPinnedToCore(function, name, StackSize, arg, priority, storage.stack, &storage.task, core);
+        assert(handle);
+        addTask(handle, StackSize);
+        return handle;
+    }
+}
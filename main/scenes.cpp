@@ -0,0 +1,231 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "scenes.h"
+#include "tonex.h"
+#include "config.h"
+#include "report.h"
+#include "delta.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace scenes
+{
+    static const char *TAG = "TONEX_CONTROLLER_SCENES";
+    static const char *NVS_NAMESPACE = "tonex";
+    static const char *NVS_BASE_KEY = "scene_base";
+
+    static const size_t DELTA_MAX_SIZE = delta::maxSize(config::SCENE_MAX_SIZE);
+
+    struct Scene
+    {
+        uint16_t size;
+        uint16_t frameSize;
+        uint16_t storedSize;
+        uint8_t raw[config::SCENE_MAX_SIZE];
+        uint8_t frame[config::SCENE_FRAME_SIZE];
+    };
+
+    static Scene store[config::SCENE_COUNT];
+    static uint8_t base[config::SCENE_MAX_SIZE];
+    static uint16_t baseSize = 0;
+    // Staging area for captures, NVS reads and writes
+    static uint8_t scratch[config::SCENE_MAX_SIZE];
+    static uint8_t blob[DELTA_MAX_SIZE];
+    static SemaphoreHandle_t mutex;
+    static StaticSemaphore_t mutexBuffer;
+
+    static void key(uint8_t scene, char *name, size_t size)
+    {
+        snprintf(name, size, "scene%d", scene);
+    }
+
+    // Must be called with mutex taken
+    static bool assign(Scene &scene, const uint8_t *raw, size_t size)
+    {
+        auto frame = Tonex::frameSetState(raw, size);
+        if (size > sizeof(scene.raw) || frame.size() > sizeof(scene.frame))
+        {
+            return false;
+        }
+        memcpy(scene.raw, raw, size);
+        std::copy(frame.begin(), frame.end(), scene.frame);
+        scene.size = size;
+        scene.frameSize = frame.size();
+        return true;
+    }
+
+    esp_err_t save(uint8_t scene, Tonex *tonex)
+    {
+        if (scene >= config::SCENE_COUNT)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        size_t size = tonex->copyState(scratch, sizeof(scratch));
+        if (!size || !assign(store[scene], scratch, size))
+        {
+            xSemaphoreGive(mutex);
+            return ESP_ERR_INVALID_STATE;
+        }
+        nvs_handle_t handle;
+        esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+        if (err == ESP_OK)
+        {
+            // The first scene becomes the base. It counts only once it is in flash,
+            // otherwise later scenes would be stored against a base lost on reboot.
+            bool newBase = !baseSize;
+            if (newBase)
+            {
+                memcpy(base, scratch, size);
+                err = nvs_set_blob(handle, NVS_BASE_KEY, base, size);
+            }
+            size_t baseLength = newBase ? size : baseSize;
+            size_t length = delta::encode(base, baseLength, scratch, size, blob);
+            char name[16];
+            key(scene, name, sizeof(name));
+            if (err == ESP_OK)
+            {
+                err = nvs_set_blob(handle, name, blob, length);
+            }
+            if (err == ESP_OK)
+            {
+                err = nvs_commit(handle);
+            }
+            if (err == ESP_OK)
+            {
+                baseSize = baseLength;
+                store[scene].storedSize = length;
+            }
+            nvs_close(handle);
+        }
+        xSemaphoreGive(mutex);
+        ESP_LOGI(TAG, "Scene %d saved: %s", scene, esp_err_to_name(err));
+        return err;
+    }
+
+    bool recall(uint8_t scene, Tonex *tonex)
+    {
+        if (scene >= config::SCENE_COUNT)
+        {
+            return false;
+        }
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        auto &stored = store[scene];
+        bool recalled = stored.size && tonex->applyState(stored.raw, stored.size, stored.frame, stored.frameSize);
+        xSemaphoreGive(mutex);
+        if (!recalled)
+        {
+            ESP_LOGW(TAG, "Scene %d not recalled", scene);
+        }
+        return recalled;
+    }
+
+    esp_err_t clear(uint8_t scene)
+    {
+        if (scene >= config::SCENE_COUNT)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        store[scene].size = 0;
+        store[scene].storedSize = 0;
+        nvs_handle_t handle;
+        esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+        if (err == ESP_OK)
+        {
+            char name[16];
+            key(scene, name, sizeof(name));
+            err = nvs_erase_key(handle, name);
+            if (err == ESP_ERR_NVS_NOT_FOUND)
+            {
+                err = ESP_OK;
+            }
+            if (err == ESP_OK)
+            {
+                err = nvs_commit(handle);
+            }
+            nvs_close(handle);
+        }
+        xSemaphoreGive(mutex);
+        return err;
+    }
+
+    void list()
+    {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        printf("base %d bytes\n", baseSize);
+        for (int scene = 0; scene < config::SCENE_COUNT; scene++)
+        {
+            if (store[scene].size)
+            {
+                printf("scene %d: %d bytes, stored as %d, frame %d\n", scene, store[scene].size, store[scene].storedSize, store[scene].frameSize);
+            }
+        }
+        xSemaphoreGive(mutex);
+    }
+
+    void init()
+    {
+        mutex = xSemaphoreCreateMutexStatic(&mutexBuffer);
+        report::addBuffer("scenes", sizeof(store) + sizeof(base) + sizeof(scratch) + sizeof(blob));
+        nvs_handle_t handle;
+        if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        {
+            ESP_LOGI(TAG, "No stored scenes");
+            return;
+        }
+        size_t size = sizeof(base);
+        if (nvs_get_blob(handle, NVS_BASE_KEY, base, &size) == ESP_OK)
+        {
+            baseSize = size;
+        }
+        int loaded = 0;
+        for (int scene = 0; baseSize && scene < config::SCENE_COUNT; scene++)
+        {
+            char name[16];
+            key(scene, name, sizeof(name));
+            size_t length = sizeof(blob);
+            if (nvs_get_blob(handle, name, blob, &length) != ESP_OK)
+            {
+                continue;
+            }
+            // A scene stored against an earlier base does not decode
+            if (!delta::decode(base, baseSize, blob, length, scratch, sizeof(scratch), size) || !assign(store[scene], scratch, size))
+            {
+                ESP_LOGW(TAG, "Scene %d is corrupted", scene);
+                continue;
+            }
+            store[scene].storedSize = length;
+            loaded++;
+        }
+        nvs_close(handle);
+        ESP_LOGI(TAG, "%d scenes loaded", loaded);
+    }
+}
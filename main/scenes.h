@@ -0,0 +1,44 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include "esp_err.h"
+
+class Tonex;
+
+// Scenes are complete pedal states (slot presets, active slot and settings)
+// captured from the pedal. Each one keeps its set state frame prebuilt, so a
+// recall is a single transfer. In NVS scenes are stored as differences to a
+// base scene, the first one captured.
+namespace scenes {
+    void init();
+    // Captures the current pedal state into the scene and stores it in NVS
+    esp_err_t save(uint8_t scene, Tonex *tonex);
+    bool recall(uint8_t scene, Tonex *tonex);
+    esp_err_t clear(uint8_t scene);
+    // Prints stored scenes and their encoded sizes
+    void list();
+}
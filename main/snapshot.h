@@ -0,0 +1,80 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+// Double-buffered seqlock for a single writer and any number of readers.
+// The writer fills the inactive buffer and flips the index, so a reader never
+// waits for the writer and only retries if it was preempted across two publishes.
+template <typename T>
+class Snapshot
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Snapshot requires a trivially copyable type");
+
+private:
+    struct Buffer
+    {
+        std::atomic<uint32_t> sequence{0};
+        T value{};
+    };
+    Buffer buffers[2];
+    std::atomic<uint8_t> active{0};
+
+public:
+    // Callers must serialize publish() between themselves
+    void publish(const T &value)
+    {
+        uint8_t next = active.load(std::memory_order_relaxed) ^ 1;
+        auto &buffer = buffers[next];
+        auto sequence = buffer.sequence.load(std::memory_order_relaxed);
+        buffer.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        buffer.value = value;
+        buffer.sequence.store(sequence + 2, std::memory_order_release);
+        active.store(next, std::memory_order_release);
+    }
+
+    T read() const
+    {
+        while (true)
+        {
+            auto &buffer = buffers[active.load(std::memory_order_acquire)];
+            auto before = buffer.sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                continue;
+            }
+            T value = buffer.value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (buffer.sequence.load(std::memory_order_relaxed) == before)
+            {
+                return value;
+            }
+        }
+    }
+};
@@ -25,57 +25,357 @@
 #include "tonex.h"
 #include "esp_log.h"
 #include "hdlc.h"
+#include "sdkconfig.h"
+#ifdef CONFIG_IDF_TARGET_LINUX
+#include "tty.h"
+#else
 #include "usb.h"
+#endif
+#include "trace.h"
+#include "metrics.h"
+#include "esp_timer.h"
+#include <freertos/task.h>
+#include "config.h"
+#include "report.h"
+#include "boot.h"
+#include "events.h"
+#include <cstring>
 #include <freertos/semphr.h>
+#include <algorithm>
+#include <inttypes.h>
 
 static const uint16_t TONEX_ONE_USB_DEVICE_VID = 0x1963;
 static const uint16_t TONEX_ONE_USB_DEVICE_PID = 0x00d1;
 
+// Positions of editable fields, counted back from the end of the state body
+static const size_t SLOT_A_PRESET_OFFSET = 18;
+static const size_t SLOT_B_PRESET_OFFSET = 16;
+static const size_t SLOT_C_PRESET_OFFSET = 14;
+static const size_t ACTIVE_SLOT_OFFSET = 11;
+static const size_t A4_REFERENCE_OFFSET = 10;
+static const size_t DIRECT_MONITORING_OFFSET = 7;
+static const size_t TEMPO_SOURCE_OFFSET = 6;
+static const size_t TEMPO_OFFSET = 5;
+// Positions counted from the start of the state body
+static const size_t INPUT_TRIM_POSITION = 4;
+static const size_t CAB_SIM_BYPASS_POSITION = 15;
+static const size_t TUNING_MODE_POSITION = 16;
+static const size_t COLORS_POSITION = 17;
+
 static const char *TAG = "TONEX_CONTROLLER_TONEX";
 
+// Link supervision: probe with requestState after this much silence, declare
+// the link dead after a few unanswered probes and force a reconnect
+static const TickType_t PROBE_IDLE_TIME = pdMS_TO_TICKS(2000);
+static const uint32_t PROBE_TIMEOUT_US = 500 * 1000;
+static const uint8_t MISSED_PROBES_DEAD = 3;
+static const TickType_t HANDSHAKE_TIMEOUT = pdMS_TO_TICKS(5000);
+// Hello and state request are repeated at this interval until the state arrives
+static const TickType_t HANDSHAKE_RETRY_TIME = pdMS_TO_TICKS(250);
+
+// Fixed requests are framed at compile time and kept in flash
+static constexpr std::array<uint8_t, 13> HELLO_MESSAGE = {0xb9, 0x03, 0x00, 0x82, 0x04, 0x00, 0x80, 0x0b, 0x01, 0xb9, 0x02, 0x02, 0x0b};
+static constexpr auto HELLO_FRAME = hdlc::addFraming(HELLO_MESSAGE);
+
+static constexpr std::array<uint8_t, 15> REQUEST_STATE_MESSAGE = {0xb9, 0x03, 0x00, 0x82, 0x06, 0x00, 0x80, 0x0b, 0x03, 0xb9, 0x02, 0x81, 0x06, 0x03, 0x0b};
+static constexpr auto REQUEST_STATE_FRAME = hdlc::addFraming(REQUEST_STATE_MESSAGE);
+
+static constexpr std::array<uint8_t, 17> requestPresetMessage(uint8_t preset)
+{
+    return {0xb9, 0x03, 0x81, 0x00, 0x03, 0x82, 0x06, 0x00, 0x80, 0x0b, 0x03, 0xb9, 0x04, 0x0b, 0x01, 0x00, preset};
+}
+
+static constexpr auto requestPresetFrames()
+{
+    std::array<hdlc::StaticFrame<17>, PRESET_COUNT> frames{};
+    for (int preset = 0; preset < PRESET_COUNT; preset++)
+    {
+        frames[preset] = hdlc::addFraming(requestPresetMessage(preset));
+    }
+    return frames;
+}
+static constexpr auto REQUEST_PRESET_FRAMES = requestPresetFrames();
+
+// All preset requests joined, so they go out in one transfer without waiting for the answers
+struct RequestBatch
+{
+    std::array<uint8_t, PRESET_COUNT * REQUEST_PRESET_FRAMES[0].data.size()> data{};
+    size_t size = 0;
+};
+
+static constexpr RequestBatch requestPresetsBatch()
+{
+    RequestBatch batch;
+    for (const auto &frame : REQUEST_PRESET_FRAMES)
+    {
+        for (size_t i = 0; i < frame.size; i++)
+        {
+            batch.data[batch.size++] = frame.data[i];
+        }
+    }
+    return batch;
+}
+static constexpr auto REQUEST_PRESETS_BATCH = requestPresetsBatch();
+#ifndef CONFIG_IDF_TARGET_LINUX
+static_assert(REQUEST_PRESETS_BATCH.size <= CONFIG_TONEX_USB_OUT_BUFFER_SIZE, "Preset request batch does not fit a CDC OUT transfer");
+#endif
+
+// CRCs as captured from the pedal communication in protocol.md
+static_assert(HELLO_FRAME.data[HELLO_FRAME.size - 3] == 0x17 && HELLO_FRAME.data[HELLO_FRAME.size - 2] == 0x8c);
+static_assert(REQUEST_STATE_FRAME.data[REQUEST_STATE_FRAME.size - 3] == 0x44 && REQUEST_STATE_FRAME.data[REQUEST_STATE_FRAME.size - 2] == 0x66);
+static_assert(REQUEST_PRESET_FRAMES[0].data[REQUEST_PRESET_FRAMES[0].size - 3] == 0xc8 && REQUEST_PRESET_FRAMES[0].data[REQUEST_PRESET_FRAMES[0].size - 2] == 0x27);
+
+static const EventBits_t HELLO_RECEIVED = BIT0;
+static const EventBits_t STATE_RECEIVED = BIT1;
+
+static metrics::Histogram linkRtt("link.rtt", "us");
+// Time between transfers carrying parts of one message
+static metrics::Histogram rxGap("usb.rx_gap", "us");
+static metrics::Counter linkMissedProbes("link.missed_probes");
+static metrics::Counter linkDead("link.dead");
+static metrics::Counter preloadHits("preload.hits");
+static metrics::Counter preloadMisses("preload.misses");
+
+static uint8_t readField(const State &state, StateField field)
+{
+    switch (field)
+    {
+    case StateField::ActiveSlot:
+        return static_cast<uint8_t>(state.currentSlot);
+    case StateField::SlotAPreset:
+        return state.slotAPreset;
+    case StateField::SlotBPreset:
+        return state.slotBPreset;
+    case StateField::SlotCPreset:
+        return state.slotCPreset;
+    }
+    return 0;
+}
+
+static void writeField(State &state, StateField field, uint8_t value)
+{
+    if (state.raw.size() < SLOT_A_PRESET_OFFSET)
+    {
+        return;
+    }
+    switch (field)
+    {
+    case StateField::ActiveSlot:
+        state.currentSlot = static_cast<Slot>(value);
+        state.raw[state.raw.size() - ACTIVE_SLOT_OFFSET] = value;
+        break;
+    case StateField::SlotAPreset:
+        state.slotAPreset = value;
+        state.raw[state.raw.size() - SLOT_A_PRESET_OFFSET] = value;
+        break;
+    case StateField::SlotBPreset:
+        state.slotBPreset = value;
+        state.raw[state.raw.size() - SLOT_B_PRESET_OFFSET] = value;
+        break;
+    case StateField::SlotCPreset:
+        state.slotCPreset = value;
+        state.raw[state.raw.size() - SLOT_C_PRESET_OFFSET] = value;
+        break;
+    }
+}
+
 void Tonex::onConnection()
 {
     ESP_LOGI(TAG, "Connected");
     connectionState = ConnectionState::Connected;
-    hello();
-    while (connectionState != ConnectionState::Helloed)
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    pendingEdits.clear();
+    presetRequestCount = 0;
+    skipPresetResponse = false;
+    xSemaphoreGive(mutex);
+    missedProbes = 0;
+    probePending = false;
+    linkHealth = LinkHealth::Healthy;
+    xEventGroupClearBits(events, HELLO_RECEIVED | STATE_RECEIVED);
+    // The pedal answers in order, so the state request does not have to wait for the hello response.
+    // The pedal may accept the line setup before its protocol side is up and drop the first
+    // requests, so they are repeated and the answer itself is the readiness signal.
+    EventBits_t bits = 0;
+    for (TickType_t start = xTaskGetTickCount(); !(bits & STATE_RECEIVED) && connectionState != ConnectionState::Disconnected &&
+                                                 xTaskGetTickCount() - start < HANDSHAKE_TIMEOUT;)
     {
-        vTaskDelay(pdMS_TO_TICKS(100));
+        if (!(bits & HELLO_RECEIVED))
+        {
+            hello();
+        }
+        requestState();
+        bits = xEventGroupWaitBits(events, HELLO_RECEIVED | STATE_RECEIVED, pdFALSE, pdTRUE, HANDSHAKE_RETRY_TIME);
     }
-    ESP_LOGI(TAG, "Helloed");
-    requestState();
-    while (connectionState != ConnectionState::StateInitialized)
+    if (connectionState == ConnectionState::Disconnected)
     {
-        ESP_LOGI(TAG, "State: %d", static_cast<int>(connectionState));
-        vTaskDelay(pdMS_TO_TICKS(100));
+        return;
+    }
+    if (!(bits & STATE_RECEIVED))
+    {
+        ESP_LOGW(TAG, "No state received (hello %s). Reconnecting", bits & HELLO_RECEIVED ? "received" : "missing");
+        transport->reconnect();
+        return;
     }
     ESP_LOGI(TAG, "Initialized");
 }
 
+// The device is gone, there is no link to supervise until it is opened again
+void Tonex::onDisconnection()
+{
+    ESP_LOGI(TAG, "Disconnected");
+    connectionState = ConnectionState::Disconnected;
+    probePending = false;
+    missedProbes = 0;
+}
+
+void Tonex::supervisor_task(void *arg)
+{
+    auto tonex = static_cast<Tonex *>(arg);
+    while (1)
+    {
+        vTaskDelay(pdMS_TO_TICKS(250));
+        tonex->supervise();
+    }
+}
+
+// Sends a lightweight probe when the link is idle and tracks missed replies
+void Tonex::supervise()
+{
+    if (connectionState != ConnectionState::StateInitialized)
+    {
+        return;
+    }
+    if (probePending)
+    {
+        if (static_cast<uint32_t>(esp_timer_get_time()) - probeSentAt <= PROBE_TIMEOUT_US)
+        {
+            return;
+        }
+        probePending = false;
+        linkMissedProbes.increment();
+        if (++missedProbes >= MISSED_PROBES_DEAD)
+        {
+            ESP_LOGE(TAG, "Pedal stopped responding. Reconnecting");
+            linkHealth = LinkHealth::Dead;
+            linkDead.increment();
+            connectionState = ConnectionState::Disconnected;
+            transport->reconnect();
+            return;
+        }
+        ESP_LOGW(TAG, "Probe not answered (%d missed)", static_cast<int>(missedProbes));
+        linkHealth = LinkHealth::Degraded;
+    }
+    // The state request would be answered with preset data in the middle of the fetch
+    if (xTaskGetTickCount() - lastRxTick > PROBE_IDLE_TIME && !fetchingPresets())
+    {
+        probeSentAt = static_cast<uint32_t>(esp_timer_get_time());
+        probePending = true;
+        requestState();
+    }
+}
+
+LinkHealth Tonex::getLinkHealth()
+{
+    return linkHealth;
+}
+
+ConnectionState Tonex::getConnectionState()
+{
+    return connectionState;
+}
+
 void Tonex::init()
 {
-    semaphore = xSemaphoreCreateBinary();
-    xSemaphoreGive(semaphore);
-    usb = USB::init(TONEX_ONE_USB_DEVICE_VID, TONEX_ONE_USB_DEVICE_PID, std::bind(&Tonex::handleMessage, this, std::placeholders::_1));
-    usb->setConnectionCallback(std::bind(&Tonex::onConnection, this));
+    mutex = xSemaphoreCreateMutexStatic(&mutexBuffer);
+    commandMutex = xSemaphoreCreateRecursiveMutexStatic(&commandMutexBuffer);
+    events = xEventGroupCreateStatic(&eventsBuffer);
+    buffer.reserve(config::MESSAGE_BUFFER_SIZE);
+    state.raw.reserve(config::MESSAGE_BUFFER_SIZE);
+#ifdef CONFIG_IDF_TARGET_LINUX
+    transport = Tty::init(Tty::devicePath(), std::bind(&Tonex::handleMessage, this, std::placeholders::_1));
+#else
+    transport = USB::init(TONEX_ONE_USB_DEVICE_VID, TONEX_ONE_USB_DEVICE_PID, std::bind(&Tonex::handleMessage, this, std::placeholders::_1));
+#endif
+    transport->setConnectionCallback(std::bind(&Tonex::onConnection, this));
+    transport->setDisconnectionCallback(std::bind(&Tonex::onDisconnection, this));
+    static report::TaskStorage<config::LINK_SUPERVISOR_TASK_STACK> taskStorage;
+    report::createTask(taskStorage, Tonex::supervisor_task, "link_supervisor", this, config::LINK_SUPERVISOR_TASK_PRIORITY, config::LINK_SUPERVISOR_TASK_CORE);
 }
 
 void Tonex::requestState()
 {
-    xSemaphoreTake(semaphore, portMAX_DELAY);
-    std::vector<uint8_t> request = {0xb9, 0x03, 0x00, 0x82, 0x06, 0x00, 0x80, 0x0b, 0x03, 0xb9, 0x02, 0x81, 0x06, 0x03, 0x0b};
-    auto framed = hdlc::addFraming(request);
-    usb->send(framed);
-    xSemaphoreGive(semaphore);
+    transport->send(REQUEST_STATE_FRAME.data.data(), REQUEST_STATE_FRAME.size);
 }
 
 void Tonex::hello()
 {
-    xSemaphoreTake(semaphore, portMAX_DELAY);
-    std::vector<uint8_t> request = {0xb9, 0x03, 0x00, 0x82, 0x04, 0x00, 0x80, 0x0b, 0x01, 0xb9, 0x02, 0x02, 0x0b};
-    auto framed = hdlc::addFraming(request);
-    usb->send(framed);
-    xSemaphoreGive(semaphore);
+    transport->send(HELLO_FRAME.data.data(), HELLO_FRAME.size);
+}
+
+void Tonex::requestPreset(uint8_t preset)
+{
+    if (preset >= PRESET_COUNT)
+    {
+        ESP_LOGW(TAG, "Invalid preset number: %d", preset);
+        return;
+    }
+    auto &frame = REQUEST_PRESET_FRAMES[preset];
+    expectPresets(preset, 1, false);
+    transport->send(frame.data.data(), frame.size);
+}
+
+void Tonex::requestPresets()
+{
+    TRACE(Tonex, Info, "Requesting %d presets in %u bytes", PRESET_COUNT, REQUEST_PRESETS_BATCH.size);
+    expectPresets(0, PRESET_COUNT, true);
+    transport->send(REQUEST_PRESETS_BATCH.data.data(), REQUEST_PRESETS_BATCH.size);
+}
+
+// Queues the preset numbers of the responses to come, the oldest are dropped when full.
+// A full fetch replaces whatever is still expected from earlier requests.
+void Tonex::expectPresets(uint8_t first, int count, bool replace)
+{
+    auto now = std::chrono::steady_clock::now();
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (replace || now - presetRequestTime > presetTimeout)
+    {
+        presetRequestHead = 0;
+        presetRequestCount = 0;
+        skipPresetResponse = false;
+    }
+    presetRequestTime = now;
+    for (int i = 0; i < count; i++)
+    {
+        if (presetRequestCount == MAX_PRESET_REQUESTS)
+        {
+            presetRequestHead = (presetRequestHead + 1) % MAX_PRESET_REQUESTS;
+            presetRequestCount--;
+        }
+        presetRequests[(presetRequestHead + presetRequestCount++) % MAX_PRESET_REQUESTS] = first + i;
+    }
+    xSemaphoreGive(mutex);
+}
+
+bool Tonex::fetchingPresets()
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool fetching = presetRequestCount && std::chrono::steady_clock::now() - presetRequestTime <= presetTimeout;
+    xSemaphoreGive(mutex);
+    return fetching;
+}
+
+bool Tonex::getPresetName(uint8_t preset, char *name, size_t size)
+{
+    if (preset >= PRESET_COUNT || !size)
+    {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool fetched = presetNames[preset][0] != 0;
+    strncpy(name, presetNames[preset], size - 1);
+    name[size - 1] = 0;
+    xSemaphoreGive(mutex);
+    return fetched;
 }
 
 void Tonex::setSlot(Slot newSlot)
@@ -85,86 +385,279 @@ void Tonex::setSlot(Slot newSlot)
         ESP_LOGW(TAG, "Tonex connection is not ready");
         return;
     }
-    ESP_LOGI(TAG, "Setting slot %d", static_cast<int>(newSlot));
-    xSemaphoreTake(semaphore, portMAX_DELAY);
-    uint16_t size = state.raw.size() & 0xFFFF;
-    std::vector<uint8_t> message = {0xb9, 0x03, 0x81, 0x06, 0x03, 0x82, static_cast<uint8_t>(size & 0xFF), static_cast<uint8_t>((size >> 8) & 0xFF), 0x80, 0x0b, 0x03};
-    state.currentSlot = newSlot;
-    state.raw[state.raw.size() - 11] = static_cast<uint8_t>(newSlot);
-    message.insert(message.end(), state.raw.begin(), state.raw.end());
-    auto framed = hdlc::addFraming(message);
-    xSemaphoreGive(semaphore);
-    usb->send(framed);
+    TRACE(Tonex, Info, "Setting slot %d", newSlot);
+    auto commandTime = static_cast<uint32_t>(esp_timer_get_time());
+    xSemaphoreTakeRecursive(commandMutex, portMAX_DELAY);
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    applyEdit(StateField::ActiveSlot, static_cast<uint8_t>(newSlot));
+    auto transition = publish();
+    auto framed = buildSetState();
+    xSemaphoreGive(mutex);
+    sendState(framed.data(), framed.size(), transition.after.version);
+    xSemaphoreGiveRecursive(commandMutex);
+    events::diff(transition.before, transition.after, events::Origin::Local, commandTime);
 }
 
-void Tonex::changePreset(Slot slot, uint8_t preset)
+bool Tonex::changePreset(Slot slot, uint8_t preset)
 {
     // TODO: update to 1.2.* needed
     if (connectionState != ConnectionState::StateInitialized) 
     {
         ESP_LOGW(TAG, "Tonex connection is not ready");
-        return;
+        return false;
     }
     if (preset >= 20)
     {
         ESP_LOGW(TAG, "Invalid preset number: %d", preset);
-        return;
+        return false;
     }
-    ESP_LOGI(TAG, "Changing preset for slot %d to %d", static_cast<int>(slot), preset);
-    xSemaphoreTake(semaphore, portMAX_DELAY);
-    uint16_t size = state.raw.size() & 0xFFFF;
-    std::vector<uint8_t> message = {0xb9, 0x03, 0x81, 0x06, 0x03, 0x82, static_cast<uint8_t>(size & 0xFF), static_cast<uint8_t>((size >> 8) & 0xFF), 0x80, 0x0b, 0x03};
+    TRACE(Tonex, Info, "Changing preset for slot %d to %d", slot, preset);
+    auto commandTime = static_cast<uint32_t>(esp_timer_get_time());
+    xSemaphoreTakeRecursive(commandMutex, portMAX_DELAY);
+    xSemaphoreTake(mutex, portMAX_DELAY);
     switch (slot)
     {
     case Slot::A:
-        state.slotAPreset = preset;
-        state.raw[state.raw.size() - 18] = preset;
+        applyEdit(StateField::SlotAPreset, preset);
         break;
     case Slot::B:
-        state.slotBPreset = preset;
-        state.raw[state.raw.size() - 16] = preset;
+        applyEdit(StateField::SlotBPreset, preset);
         break;
     case Slot::C:
-        state.slotCPreset = preset;
-        state.raw[state.raw.size() - 14] = preset;
+        applyEdit(StateField::SlotCPreset, preset);
         break;
     }
-    message.insert(message.end(), state.raw.begin(), state.raw.end());
-    auto framed = hdlc::addFraming(message);
-    xSemaphoreGive(semaphore);
-    usb->send(framed);
+    auto transition = publish();
+    auto framed = buildSetState();
+    xSemaphoreGive(mutex);
+    sendState(framed.data(), framed.size(), transition.after.version);
+    xSemaphoreGiveRecursive(commandMutex);
+    events::diff(transition.before, transition.after, events::Origin::Local, commandTime);
+    return true;
+}
+
+// Must be called with mutex taken
+void Tonex::applyEdit(StateField field, uint8_t value)
+{
+    writeField(state, field, value);
+    state.version = ++localVersion;
+    // A newer edit of the same field supersedes the pending one
+    pendingEdits.erase(std::remove_if(pendingEdits.begin(), pendingEdits.end(),
+                                      [field](const PendingEdit &edit) { return edit.field == field; }),
+                       pendingEdits.end());
+    pendingEdits.push_back({field, value, state.version, false, {}});
+}
+
+// Must be called with commandMutex taken. Marks the edits carried by the frame as sent,
+// from then on an echo can confirm them and their timeout runs.
+void Tonex::sendState(const uint8_t *frame, size_t size, uint32_t version)
+{
+    transport->send(frame, size);
+    auto now = std::chrono::steady_clock::now();
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (auto &edit : pendingEdits)
+    {
+        if (!edit.sent && edit.version <= version)
+        {
+            edit.sent = true;
+            edit.sentAt = now;
+        }
+    }
+    xSemaphoreGive(mutex);
+}
+
+// Must be called with mutex taken
+std::vector<uint8_t> Tonex::buildSetState()
+{
+    return frameSetState(state.raw.data(), state.raw.size());
+}
+
+std::vector<uint8_t> Tonex::frameSetState(const uint8_t *raw, size_t rawSize)
+{
+    uint16_t size = rawSize & 0xFFFF;
+    std::vector<uint8_t> message = {0xb9, 0x03, 0x81, 0x06, 0x03, 0x82, static_cast<uint8_t>(size & 0xFF), static_cast<uint8_t>((size >> 8) & 0xFF), 0x80, 0x0b, 0x03};
+    message.insert(message.end(), raw, raw + rawSize);
+    return hdlc::addFraming(message);
+}
+
+size_t Tonex::copyState(uint8_t *raw, size_t capacity)
+{
+    if (connectionState != ConnectionState::StateInitialized)
+    {
+        return 0;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    size_t size = state.raw.size();
+    if (size <= capacity)
+    {
+        std::copy(state.raw.begin(), state.raw.end(), raw);
+    }
+    xSemaphoreGive(mutex);
+    return size <= capacity ? size : 0;
+}
+
+bool Tonex::applyState(const uint8_t *raw, size_t size, const uint8_t *frame, size_t frameSize)
+{
+    if (connectionState != ConnectionState::StateInitialized)
+    {
+        ESP_LOGW(TAG, "Tonex connection is not ready");
+        return false;
+    }
+    auto commandTime = static_cast<uint32_t>(esp_timer_get_time());
+    xSemaphoreTakeRecursive(commandMutex, portMAX_DELAY);
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    // Offsets are relative to the end of the body, a body of another size comes from other firmware
+    if (size != state.raw.size() || size < SLOT_A_PRESET_OFFSET)
+    {
+        xSemaphoreGive(mutex);
+        xSemaphoreGiveRecursive(commandMutex);
+        ESP_LOGW(TAG, "State of %u bytes does not match the pedal (%u bytes)", static_cast<unsigned>(size), static_cast<unsigned>(state.raw.size()));
+        return false;
+    }
+    std::copy(raw, raw + size, state.raw.begin());
+    parseSettings(state.raw, state.settings);
+    // Slot fields are tracked as edits, so an echo of the previous state does not revert them
+    applyEdit(StateField::SlotAPreset, raw[size - SLOT_A_PRESET_OFFSET]);
+    applyEdit(StateField::SlotBPreset, raw[size - SLOT_B_PRESET_OFFSET]);
+    applyEdit(StateField::SlotCPreset, raw[size - SLOT_C_PRESET_OFFSET]);
+    applyEdit(StateField::ActiveSlot, raw[size - ACTIVE_SLOT_OFFSET]);
+    auto transition = publish();
+    xSemaphoreGive(mutex);
+    TRACE(Tonex, Info, "Applying state of %u bytes in a single frame", size);
+    sendState(frame, frameSize, transition.after.version);
+    xSemaphoreGiveRecursive(commandMutex);
+    events::diff(transition.before, transition.after, events::Origin::Local, commandTime);
+    return true;
+}
+
+// Merges a StateUpdate from the pedal with local edits it has not confirmed yet.
+// Must be called with mutex taken
+void Tonex::reconcile(State &incoming)
+{
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = pendingEdits.begin(); it != pendingEdits.end();)
+    {
+        if (!it->sent)
+        {
+            // The pedal has not seen this edit yet, whatever it reports is older
+            writeField(incoming, it->field, it->value);
+            ++it;
+        }
+        else if (readField(incoming, it->field) == it->value)
+        {
+            confirmedVersion = std::max(confirmedVersion, it->version);
+            it = pendingEdits.erase(it);
+        }
+        else if (now - it->sentAt > editTimeout)
+        {
+            ESP_LOGW(TAG, "Edit v%" PRIu32 " was not confirmed by pedal. Dropping", it->version);
+            it = pendingEdits.erase(it);
+        }
+        else
+        {
+            // Echo of a state older than our edit, keep the edit on top of it
+            writeField(incoming, it->field, it->value);
+            ++it;
+        }
+    }
+    incoming.version = ++localVersion;
 }
 
 Slot Tonex::getCurrentSlot()
 {
-    return state.currentSlot;
+    return published.read().currentSlot;
 }
 
 uint8_t Tonex::getPreset(Slot slot)
 {
+    auto snapshot = published.read();
     switch(slot)
     {
         case Slot::A:
-            return state.slotAPreset;
+            return snapshot.slotAPreset;
         case Slot::B:
-            return state.slotBPreset;
+            return snapshot.slotBPreset;
         case Slot::C:
-            return state.slotCPreset;
+            return snapshot.slotCPreset;
     }
 
     return 0;
 }
 
+StateSnapshot Tonex::getState()
+{
+    return published.read();
+}
+
+// Must be called with mutex taken. Subscribers are notified of the returned
+// transition by the caller after the mutex is released.
+Transition Tonex::publish()
+{
+    Transition transition;
+    transition.before = published.read();
+    transition.after = {state.slotAPreset, state.slotBPreset, state.slotCPreset, state.currentSlot, state.settings, state.version};
+    published.publish(transition.after);
+    return transition;
+}
+
 void Tonex::switchSilently(uint8_t value)
 {
-    auto notActiveSlot = state.currentSlot == Slot::A ? Slot::B : Slot::A;
+    // A preload cannot touch the inactive slot between the check and the switch
+    xSemaphoreTakeRecursive(commandMutex, portMAX_DELAY);
+    auto notActiveSlot = getCurrentSlot() == Slot::A ? Slot::B : Slot::A;
+    bool preloaded = preloadedPreset == value && preloadedSlot == notActiveSlot;
+    preloadedPreset = NO_PRESET;
+    if (getPreset(notActiveSlot) == value)
+    {
+        // Already in the inactive slot, a single send is enough
+        if (preloaded)
+        {
+            preloadHits.increment();
+            TRACE(Tonex, Info, "Preload hit for preset %d, hits: %u, misses: %u", value, preloadHits.get(), preloadMisses.get());
+        }
+        setSlot(notActiveSlot);
+        xSemaphoreGiveRecursive(commandMutex);
+        return;
+    }
+    preloadMisses.increment();
+    TRACE(Tonex, Info, "Preload miss for preset %d, hits: %u, misses: %u", value, preloadHits.get(), preloadMisses.get());
     changePreset(notActiveSlot, value);
     setSlot(notActiveSlot);
+    xSemaphoreGiveRecursive(commandMutex);
+}
+
+bool Tonex::preload(uint8_t preset, const std::function<bool()> &wanted)
+{
+    xSemaphoreTakeRecursive(commandMutex, portMAX_DELAY);
+    // The caller decided on an older state, a command executed since then makes it stale
+    auto inactiveSlot = getCurrentSlot() == Slot::A ? Slot::B : Slot::A;
+    bool load = wanted() && getPreset(inactiveSlot) != preset;
+    if (load)
+    {
+        TRACE(Tonex, Info, "Preloading preset %d into slot %d", preset, inactiveSlot);
+        // Only a preset that was sent can be a preload hit later
+        load = changePreset(inactiveSlot, preset);
+    }
+    if (load)
+    {
+        preloadedSlot = inactiveSlot;
+        preloadedPreset = preset;
+    }
+    xSemaphoreGiveRecursive(commandMutex);
+    return load;
 }
 
-void Tonex::handleMessage(std::vector<uint8_t> raw)
+void Tonex::handleMessage(const std::vector<uint8_t> &raw)
 {
     auto currentTime = std::chrono::steady_clock::now();
+    lastRxTick = xTaskGetTickCount();
+    // Bytes left in the buffer are an incomplete frame, this transfer continues it
+    int64_t now = esp_timer_get_time();
+    if (!buffer.empty())
+    {
+        rxGap.record(static_cast<uint32_t>(std::min<int64_t>(now - lastTransferTime, UINT32_MAX)));
+    }
+    lastTransferTime = now;
 
     if (!buffer.empty() && (currentTime - lastByteTime) > messageTimeout)
     {
@@ -187,6 +680,7 @@ void Tonex::handleMessage(std::vector<uint8_t> raw)
 
 void Tonex::processBuffer()
 {
+    auto receivedAt = static_cast<uint32_t>(esp_timer_get_time());
     if (buffer.size() >= 2 && buffer.front() == 0x7E && buffer.back() == 0x7E)
     {
         auto [status, msg] = parse(buffer);
@@ -202,22 +696,71 @@ void Tonex::processBuffer()
         switch (msg->header.type)
         {
         case Type::StateUpdate:
-            xSemaphoreTake(semaphore, portMAX_DELAY);
+        {
+            Transition transition;
+            xSemaphoreTake(mutex, portMAX_DELAY);
             {
-                this->state = *static_cast<State *>(msg);
-                ESP_LOGI(TAG, "Received StateUpdate. Current slot: %d", static_cast<int>(this->state.currentSlot));
+                auto incoming = *static_cast<State *>(msg);
+                reconcile(incoming);
+                this->state = std::move(incoming);
+                transition = publish();
+                TRACE(Tonex, Info, "Received StateUpdate. Current slot: %d, version: %u, confirmed: %u, pending edits: %u",
+                      this->state.currentSlot, this->state.version, confirmedVersion, pendingEdits.size());
                 connectionState = ConnectionState::StateInitialized;
+                if (probePending.exchange(false))
+                {
+                    linkRtt.record(static_cast<uint32_t>(esp_timer_get_time()) - probeSentAt);
+                }
+                missedProbes = 0;
+                linkHealth = LinkHealth::Healthy;
+                skipPresetResponse = presetRequestCount > 0;
             }
-            xSemaphoreGive(semaphore);
+            xSemaphoreGive(mutex);
+            xEventGroupSetBits(events, STATE_RECEIVED);
+            boot::mark(boot::StateReceived);
+            events::diff(transition.before, transition.after, events::Origin::Pedal, receivedAt);
             break;
+        }
         case Type::Hello:
+        {
             ESP_LOGI(TAG, "Received Hello");
-            xSemaphoreTake(semaphore, portMAX_DELAY);
-            connectionState = ConnectionState::Helloed;
-            xSemaphoreGive(semaphore);
+            auto expected = ConnectionState::Connected;
+            connectionState.compare_exchange_strong(expected, ConnectionState::Helloed);
+            xEventGroupSetBits(events, HELLO_RECEIVED);
+            boot::mark(boot::Helloed);
             break;
+        }
+        case Type::PresetResponse:
+        {
+            auto preset = static_cast<PresetData *>(msg);
+            auto now = std::chrono::steady_clock::now();
+            xSemaphoreTake(mutex, portMAX_DELAY);
+            if (presetRequestCount && now - presetRequestTime > presetTimeout)
+            {
+                TRACE(Tonex, Warn, "%d preset requests not answered. Dropping", presetRequestCount);
+                presetRequestCount = 0;
+            }
+            if (presetRequestCount && !skipPresetResponse)
+            {
+                uint8_t number = presetRequests[presetRequestHead];
+                presetRequestHead = (presetRequestHead + 1) % MAX_PRESET_REQUESTS;
+                presetRequestCount--;
+                // Each answer restarts the timeout, a batch is answered one preset after another
+                presetRequestTime = now;
+                memcpy(presetNames[number], preset->name, PRESET_NAME_SIZE);
+                TRACE(Tonex, Info, "Received preset %d", number);
+            }
+            else
+            {
+                // Sent on its own after a state update, its number is not known
+                TRACE(Tonex, Debug, "Unrequested preset data");
+            }
+            skipPresetResponse = false;
+            xSemaphoreGive(mutex);
+            break;
+        }
         default:
-            ESP_LOGI(TAG, "Message unknown");
+            TRACE(Tonex, Debug, "Message unknown");
             break;
         }
         delete msg;
@@ -274,14 +817,16 @@ std::tuple<Status, Message *> Tonex::parse(const std::vector<uint8_t> &message)
     case 0x02:
         header.type = Type::Hello;
         break;
+    case 0x0304:
+        header.type = Type::PresetResponse;
+        break;
     default:
         header.type = Type::Unknown;
         break;
     };
     header.size = parseValue(unframed, index);
     header.unknown = parseValue(unframed, index);
-    ESP_LOGI(TAG, "Structure ID: %d", header.type);
-    ESP_LOGI(TAG, "Size: %d", header.size);
+    TRACE(Tonex, Debug, "Structure ID: %d, size: %d", header.type, header.size);
 
     if (unframed.size() - index != header.size)
     {
@@ -299,9 +844,11 @@ std::tuple<Status, Message *> Tonex::parse(const std::vector<uint8_t> &message)
     }
     case Type::StateUpdate:
         return parseState(unframed, index);
+    case Type::PresetResponse:
+        return parsePreset(unframed, index);
     default:
     {
-        ESP_LOGI(TAG, "Unknown structure. Skipping.");
+        TRACE(Tonex, Debug, "Unknown structure. Skipping.");
         auto msg = new Message();
         msg->header = header;
         return {Status::OK, msg};
@@ -324,8 +871,66 @@ std::tuple<Status, State *> Tonex::parseState(const std::vector<uint8_t> &unfram
     state->slotCPreset = unframed[index];
     index += 3;
     state->currentSlot = static_cast<Slot>(unframed[index]);
-    ESP_LOGI(TAG, "Current slot: %c", slotName[static_cast<int>(state->currentSlot)]);
-    ESP_LOGI(TAG, "Presets: A: %d, B: %d, C: %d", state->slotAPreset, state->slotBPreset, state->slotCPreset);
+    parseSettings(state->raw, state->settings);
+    TRACE(Tonex, Debug, "Current slot: %c", slotName[static_cast<int>(state->currentSlot)]);
+    TRACE(Tonex, Debug, "Presets: A: %d, B: %d, C: %d", state->slotAPreset, state->slotBPreset, state->slotCPreset);
     initialized = true;
     return {Status::OK, state};
 }
+
+std::tuple<Status, PresetData *> Tonex::parsePreset(const std::vector<uint8_t> &unframed, size_t index)
+{
+    // The name is the first string element (0xBC, length, bytes) of the body
+    static const size_t NAME_SEARCH_LIMIT = 16;
+    auto preset = new PresetData();
+    preset->header.type = Type::PresetResponse;
+    memset(preset->name, 0, sizeof(preset->name));
+    for (size_t end = std::min(unframed.size(), index + NAME_SEARCH_LIMIT); index + 1 < end; index++)
+    {
+        if (unframed[index] == 0xbc)
+        {
+            size_t length = std::min<size_t>(unframed[index + 1], std::min(sizeof(preset->name) - 1, unframed.size() - index - 2));
+            memcpy(preset->name, &unframed[index + 2], length);
+            break;
+        }
+    }
+    return {Status::OK, preset};
+}
+
+static float parseFloat(const std::vector<uint8_t> &raw, size_t position)
+{
+    float value = 0;
+    if (position + 5 <= raw.size() && raw[position] == 0x88)
+    {
+        memcpy(&value, &raw[position + 1], sizeof(value));
+    }
+    return value;
+}
+
+void Tonex::parseSettings(const std::vector<uint8_t> &raw, Settings &settings)
+{
+    settings = {};
+    if (raw.size() < COLORS_POSITION + 2 || raw.size() < SLOT_A_PRESET_OFFSET)
+    {
+        return;
+    }
+    settings.inputTrim = parseFloat(raw, INPUT_TRIM_POSITION);
+    settings.cabSimBypass = raw[CAB_SIM_BYPASS_POSITION];
+    settings.tuningMode = raw[TUNING_MODE_POSITION];
+
+    // ba 14, then b9 03 R G B for every preset. 0xFF values are prefixed with 0x80
+    size_t index = COLORS_POSITION + 2;
+    for (int preset = 0; preset < PRESET_COUNT && index + 11 <= raw.size(); preset++)
+    {
+        index += 2;
+        settings.colors[preset].red = parseValue(raw, index);
+        settings.colors[preset].green = parseValue(raw, index);
+        settings.colors[preset].blue = parseValue(raw, index);
+    }
+
+    size_t a4Position = raw.size() - A4_REFERENCE_OFFSET;
+    settings.a4Reference = (raw[a4Position + 2] << 8) | raw[a4Position + 1];
+    settings.directMonitoring = raw[raw.size() - DIRECT_MONITORING_OFFSET];
+    settings.tempoSource = raw[raw.size() - TEMPO_SOURCE_OFFSET];
+    settings.tempo = parseFloat(raw, raw.size() - TEMPO_OFFSET);
+}
@@ -26,9 +26,13 @@
 #include <cstdint>
 #include <vector>
 #include <tuple>
-#include "usb.h"
+#include "transport.h"
 #include <freertos/semphr.h>
 #include <chrono>
+#include <atomic>
+#include <functional>
+#include "snapshot.h"
+#include <freertos/event_groups.h>
 
 enum Status {
     OK,
@@ -38,7 +42,8 @@ enum Status {
 enum Type {
     Unknown,
     StateUpdate,
-    Hello
+    Hello,
+    PresetResponse
 };
 enum Slot
 {
@@ -54,14 +59,65 @@ struct Header
 };
 struct Message {
     Header header;
+    virtual ~Message() = default;
 };
+static const int PRESET_COUNT = 20;
+// Name field of a preset is 33 bytes
+static const size_t PRESET_NAME_SIZE = 34;
+
+struct Color
+{
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+};
+
+// Pedal settings decoded from the state body
+struct Settings
+{
+    float inputTrim;
+    uint8_t cabSimBypass;
+    uint8_t tuningMode;
+    Color colors[PRESET_COUNT];
+    uint16_t a4Reference;
+    uint8_t directMonitoring;
+    uint8_t tempoSource;
+    float tempo;
+};
+
 struct State : public Message
 {
     uint8_t slotAPreset;
     uint8_t slotBPreset;
     uint8_t slotCPreset;
     Slot currentSlot;
+    Settings settings;
     std::vector<uint8_t> raw;
+    uint32_t version = 0;
+};
+
+// Preset response. Only the name is decoded, the rest of the body is not analyzed yet
+struct PresetData : public Message
+{
+    char name[PRESET_NAME_SIZE];
+};
+
+enum StateField {
+    ActiveSlot,
+    SlotAPreset,
+    SlotBPreset,
+    SlotCPreset
+};
+
+// Local edit not yet seen in a StateUpdate. It can be confirmed only after
+// the frame carrying it was sent, any echo before that is a stale state.
+struct PendingEdit
+{
+    StateField field;
+    uint8_t value;
+    uint32_t version;
+    bool sent;
+    std::chrono::steady_clock::time_point sentAt;
 };
 
 enum ConnectionState {
@@ -70,31 +126,116 @@ enum ConnectionState {
     Helloed,
     StateInitialized
 };
+
+enum LinkHealth {
+    Healthy,
+    Degraded,
+    Dead
+};
+
+// Copy of the state published for readers outside of the protocol task
+struct StateSnapshot
+{
+    uint8_t slotAPreset;
+    uint8_t slotBPreset;
+    uint8_t slotCPreset;
+    Slot currentSlot;
+    Settings settings;
+    uint32_t version;
+};
+
+struct Transition
+{
+    StateSnapshot before;
+    StateSnapshot after;
+};
 class Tonex
 {
 private:
-    ConnectionState connectionState = ConnectionState::Disconnected;
-    SemaphoreHandle_t semaphore;
-    std::unique_ptr<USB> usb; 
+    std::atomic<ConnectionState> connectionState{ConnectionState::Disconnected};
+    SemaphoreHandle_t mutex;
+    StaticSemaphore_t mutexBuffer;
+    // Held from building a set state frame until it is sent, so frames reach the pedal in version
+    // order, and across multi-step commands (switchSilently, preload) so they do not interleave
+    SemaphoreHandle_t commandMutex;
+    StaticSemaphore_t commandMutexBuffer;
+    // Preset loaded by preload, guarded by commandMutex
+    static const uint8_t NO_PRESET = 0xFF;
+    Slot preloadedSlot = Slot::A;
+    uint8_t preloadedPreset = NO_PRESET;
+    Transport *transport;
     State state;
+    Snapshot<StateSnapshot> published;
+    Transition publish();
+    void parseSettings(const std::vector<uint8_t> &raw, Settings &settings);
     uint16_t parseValue(const std::vector<uint8_t> &message, size_t &index);
     std::tuple<Status, Message*> parse(const std::vector<uint8_t> &message);
     std::tuple<Status, State*> parseState(const std::vector<uint8_t> &unframed, size_t &index);
+    std::tuple<Status, PresetData*> parsePreset(const std::vector<uint8_t> &unframed, size_t index);
+    // Responses carry no preset number, the pedal answers requests in order. Guarded by mutex.
+    static const int MAX_PRESET_REQUESTS = 2 * PRESET_COUNT;
+    uint8_t presetRequests[MAX_PRESET_REQUESTS];
+    int presetRequestHead = 0;
+    int presetRequestCount = 0;
+    // Requests not answered within presetTimeout are dropped, so a lost response does not shift later ones
+    std::chrono::steady_clock::time_point presetRequestTime;
+    const std::chrono::milliseconds presetTimeout{1000};
+    // A state update is followed by preset data nobody asked for, it must not take a requested number
+    bool skipPresetResponse = false;
+    char presetNames[PRESET_COUNT][PRESET_NAME_SIZE] = {};
+    void expectPresets(uint8_t first, int count, bool replace);
+    bool fetchingPresets();
     std::vector<uint8_t> buffer;
     std::chrono::steady_clock::time_point lastByteTime;
+    int64_t lastTransferTime = 0;
     const std::chrono::milliseconds messageTimeout{1000}; 
+    std::vector<PendingEdit> pendingEdits;
+    uint32_t localVersion = 0;
+    uint32_t confirmedVersion = 0;
+    const std::chrono::milliseconds editTimeout{1000};
+    void applyEdit(StateField field, uint8_t value);
+    void reconcile(State &incoming);
+    std::vector<uint8_t> buildSetState();
+    void sendState(const uint8_t *frame, size_t size, uint32_t version);
+    std::atomic<LinkHealth> linkHealth{LinkHealth::Healthy};
+    std::atomic<TickType_t> lastRxTick{0};
+    std::atomic<bool> probePending{false};
+    std::atomic<uint32_t> probeSentAt{0};
+    std::atomic<uint8_t> missedProbes{0};
+    static void supervisor_task(void *arg);
+    void supervise();
+    EventGroupHandle_t events;
+    StaticEventGroup_t eventsBuffer;
     void processBuffer();
     bool initialized;
     void onConnection();
-    void requestState();
+    void onDisconnection();
     void hello();
     
 public:
     void setSlot(Slot slot);
-    void handleMessage(std::vector<uint8_t> raw);
+    void handleMessage(const std::vector<uint8_t> &raw);
     void init();
-    void changePreset(Slot slot, uint8_t value);
+    // False if the frame was not sent, e.g. before the pedal state is known
+    bool changePreset(Slot slot, uint8_t value);
     Slot getCurrentSlot();
     uint8_t getPreset(Slot slot);
+    StateSnapshot getState();
+    LinkHealth getLinkHealth();
+    ConnectionState getConnectionState();
+    void requestState();
+    void requestPreset(uint8_t preset);
+    // Requests all presets in a single transfer, the answers are pipelined
+    void requestPresets();
+    // Name from the last preset response, false if the preset was not fetched
+    bool getPresetName(uint8_t preset, char *name, size_t size);
     void switchSilently(uint8_t value);
+    // Loads the preset into the inactive slot if wanted() still holds once no command is in progress.
+    // True only if the preset was sent to the pedal.
+    bool preload(uint8_t preset, const std::function<bool()> &wanted);
+    // Copies the body of the current state. Returns its size, 0 if there is no state or it does not fit.
+    size_t copyState(uint8_t *raw, size_t capacity);
+    // Replaces the whole state with a body captured by copyState and sends its prebuilt set state frame
+    bool applyState(const uint8_t *raw, size_t size, const uint8_t *frame, size_t frameSize);
+    static std::vector<uint8_t> frameSetState(const uint8_t *raw, size_t size);
 };
\ No newline at end of file
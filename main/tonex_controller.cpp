@@ -22,14 +22,48 @@
  * SOFTWARE.
  */
 
+#include "sdkconfig.h"
+#ifndef CONFIG_IDF_TARGET_LINUX
 #include "midi.h"
-#include "usb.h"
+#endif
+#include "boot.h"
 #include "tonex.h"
+#include "trace.h"
+#include "mapping.h"
+#include "scenes.h"
+#include "nvs_flash.h"
+#include "preload.h"
+#include "report.h"
+#include "console.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 Tonex tonex;
 
 extern "C" void app_main(void)
 {   
+    trace::init();
+    // USB enumeration takes the longest, start it before loading settings
     tonex.init();
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(err);
+    mapping::init();
+    scenes::init();
+    preload::init(&tonex);
+#ifdef CONFIG_IDF_TARGET_LINUX
+    // No MIDI on the host, ready as soon as the pedal state is in
+    boot::mark(boot::MidiReady);
+#else
     midi::init(&tonex);
+#endif
+    console::init(&tonex);
+
+    // Let the tasks run through connection before reporting stack usage
+    vTaskDelay(pdMS_TO_TICKS(10000));
+    report::log();
 }
\ No newline at end of file
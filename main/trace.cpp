@@ -0,0 +1,147 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "trace.h"
+#include <atomic>
+#include <cstdio>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "config.h"
+#include "report.h"
+
+namespace trace {
+
+static const uint32_t RING_SIZE = CONFIG_TONEX_TRACE_RING_SIZE;
+static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "Trace ring size must be a power of two");
+
+static const char *TAGS[] = {"TONEX_CONTROLLER_USB", "TONEX_CONTROLLER_TONEX", "TONEX_CONTROLLER_MIDI"};
+static const char *TAG = "TONEX_CONTROLLER_TRACE";
+
+// Bounded multi-producer queue. Each cell's sequence tells whether it is free
+// for the producer at that position or ready for the consumer.
+struct Cell
+{
+    std::atomic<uint32_t> sequence;
+    Record record;
+};
+
+static Cell ring[RING_SIZE];
+static std::atomic<uint32_t> head{0};
+static uint32_t tail = 0;
+static std::atomic<uint32_t> dropped{0};
+
+void write(Module module, Level level, const char *format, uint8_t argc, const uint32_t *args)
+{
+    auto position = head.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true)
+    {
+        cell = &ring[position & (RING_SIZE - 1)];
+        auto sequence = cell->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<int32_t>(sequence - position);
+        if (diff == 0)
+        {
+            if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // Full, never block the caller
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            position = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->record.timestamp = static_cast<uint32_t>(esp_timer_get_time());
+    cell->record.format = format;
+    cell->record.module = module;
+    cell->record.level = level;
+    cell->record.argc = argc;
+    for (int i = 0; i < MAX_ARGS; i++)
+    {
+        cell->record.args[i] = i < argc ? args[i] : 0;
+    }
+    cell->sequence.store(position + 1, std::memory_order_release);
+}
+
+static bool pop(Record &record)
+{
+    auto &cell = ring[tail & (RING_SIZE - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != tail + 1)
+    {
+        return false;
+    }
+    record = cell.record;
+    cell.sequence.store(tail + RING_SIZE, std::memory_order_release);
+    tail++;
+    return true;
+}
+
+static void format(const Record &record)
+{
+    char line[128];
+    snprintf(line, sizeof(line), record.format, record.args[0], record.args[1], record.args[2], record.args[3]);
+    auto tag = TAGS[static_cast<int>(record.module)];
+    auto level = static_cast<esp_log_level_t>(record.level);
+    ESP_LOG_LEVEL(level, tag, "[%" PRIu32 "] %s", record.timestamp, line);
+}
+
+static void trace_task(void *arg)
+{
+    Record record;
+    while (1)
+    {
+        while (pop(record))
+        {
+            format(record);
+        }
+        auto lost = dropped.exchange(0, std::memory_order_relaxed);
+        if (lost)
+        {
+            ESP_LOGW(TAG, "%" PRIu32 " trace records dropped", lost);
+        }
+        vTaskDelay(pdMS_TO_TICKS(50));
+    }
+}
+
+void init()
+{
+    for (uint32_t i = 0; i < RING_SIZE; i++)
+    {
+        ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    static report::TaskStorage<config::TRACE_TASK_STACK> taskStorage;
+    report::createTask(taskStorage, trace_task, "trace", NULL, config::TRACE_TASK_PRIORITY, config::TRACE_TASK_CORE);
+    report::addBuffer("trace", sizeof(ring));
+}
+};
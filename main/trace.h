@@ -0,0 +1,108 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+#include "sdkconfig.h"
+
+// Deferred logging for hot paths. TRACE() stores a pointer to the format
+// string and up to four raw 32-bit arguments in a lock-free ring buffer; a low
+// priority task formats them later. Only integer conversions (%d, %u, %x, %c)
+// are allowed in trace formats. The format pointer doubles as the record ID, so
+// a host-side decoder can resolve it from the ELF file.
+//
+// Records above the compile time level of their module are compiled out.
+#define TRACE(module, level, format, ...)                                                        \
+    do                                                                                           \
+    {                                                                                            \
+        if constexpr (trace::enabled(trace::Module::module, trace::Level::level))                \
+        {                                                                                        \
+            trace::record(trace::Module::module, trace::Level::level, format, ##__VA_ARGS__);    \
+        }                                                                                        \
+    } while (0)
+
+namespace trace {
+
+static const int MAX_ARGS = 4;
+
+enum class Level : uint8_t {
+    None = 0,
+    Error,
+    Warn,
+    Info,
+    Debug,
+    Verbose
+};
+
+enum class Module : uint8_t {
+    Usb,
+    Tonex,
+    Midi
+};
+
+struct Record
+{
+    uint32_t timestamp;
+    const char *format;
+    Module module;
+    Level level;
+    uint8_t argc;
+    uint32_t args[MAX_ARGS];
+};
+
+constexpr bool enabled(Module module, Level level)
+{
+    switch (module)
+    {
+    case Module::Usb:
+        return static_cast<int>(level) <= CONFIG_TONEX_TRACE_LEVEL_USB;
+    case Module::Tonex:
+        return static_cast<int>(level) <= CONFIG_TONEX_TRACE_LEVEL_TONEX;
+    case Module::Midi:
+        return static_cast<int>(level) <= CONFIG_TONEX_TRACE_LEVEL_MIDI;
+    }
+    return false;
+}
+
+void write(Module module, Level level, const char *format, uint8_t argc, const uint32_t *args);
+
+template <typename T>
+constexpr uint32_t toWord(T value)
+{
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "Only integers and enums can be traced");
+    return static_cast<uint32_t>(value);
+}
+
+template <typename... Args>
+inline void record(Module module, Level level, const char *format, Args... args)
+{
+    static_assert(sizeof...(Args) <= MAX_ARGS, "Too many trace arguments");
+    const uint32_t words[MAX_ARGS + 1] = {toWord(args)...};
+    write(module, level, format, sizeof...(Args), words);
+}
+
+void init();
+};
@@ -0,0 +1,62 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+
+// Byte stream to the pedal. Implemented by USB (CDC-ACM host on the ESP32) and
+// Tty (/dev/ttyACM* on the linux target). Received data is handed over to the
+// message callback given to the implementation's init.
+class Transport {
+public:
+    virtual ~Transport() = default;
+    // Sends data in a single transfer. Several frames can be joined into one send
+    // to pipeline requests, the pedal answers them in order.
+    virtual void send(const uint8_t *data, size_t size) = 0;
+    void send(const std::vector<uint8_t> &data)
+    {
+        send(data.data(), data.size());
+    }
+    virtual void setConnectionCallback(std::function<void(void)> callback) = 0;
+    // Called once when an opened device goes away, from a task of the transport. Must not block.
+    virtual void setDisconnectionCallback(std::function<void(void)> callback) = 0;
+    // Drops a device that is connected but not responding and opens it again
+    virtual void reconnect() = 0;
+
+protected:
+    static constexpr uint32_t RECONNECT_BASE_DELAY_MS = 100;
+    static constexpr uint32_t RECONNECT_MAX_DELAY_MS = 5000;
+    // Jittered exponential backoff between failed open attempts, random comes from the
+    // random source of the target
+    static uint32_t backoffDelay(uint32_t attempt, uint32_t random)
+    {
+        uint32_t delay = std::min(RECONNECT_BASE_DELAY_MS << std::min<uint32_t>(attempt, 6), RECONNECT_MAX_DELAY_MS);
+        return delay / 2 + random % (delay / 2 + 1);
+    }
+};
@@ -0,0 +1,283 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tty.h"
+
+#include "esp_log.h"
+#include "trace.h"
+#include "metrics.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "config.h"
+#include "report.h"
+#include "boot.h"
+#include <random>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+
+static const char *TAG = "TONEX_CONTROLLER_TTY";
+
+static const int TX_TIMEOUT_MS = 1000;
+// Tasks of the simulated scheduler must not sit in a system call for long,
+// so waits are short and repeated
+static const int RX_POLL_MS = 20;
+static const size_t READ_SIZE = 2048;
+
+// Same names as the USB transport, so stats compare between targets
+static metrics::Counter openFailures("usb.open_failures");
+static metrics::Counter reconnects("usb.reconnects");
+static metrics::Counter errors("usb.errors");
+static metrics::Counter rxBytes("usb.rx_bytes");
+static metrics::Histogram rxFill("usb.rx_fill", "%");
+
+static uint8_t readBuffer[READ_SIZE];
+
+const char *Tty::devicePath()
+{
+    auto path = getenv("TONEX_TTY");
+    return path && *path ? path : CONFIG_TONEX_TTY_DEVICE;
+}
+
+// Opens the tty in raw mode with DTR set, like the line setup of the USB transport
+bool Tty::open()
+{
+    int device = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (device < 0)
+    {
+        return false;
+    }
+    termios options;
+    if (tcgetattr(device, &options) != 0)
+    {
+        ::close(device);
+        return false;
+    }
+    cfmakeraw(&options);
+    cfsetspeed(&options, B9600);
+    options.c_cflag |= CLOCAL | CREAD;
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    if (tcsetattr(device, TCSANOW, &options) != 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, device, &event) != 0)
+    {
+        ESP_LOGE(TAG, "Failed to set up %s: %s", path, strerror(errno));
+        ::close(device);
+        return false;
+    }
+    // Ttys without modem lines (e.g. a pseudo terminal of a simulator) do not have DTR
+    int dtr = TIOCM_DTR;
+    if (ioctl(device, TIOCMBIS, &dtr) != 0)
+    {
+        ESP_LOGW(TAG, "DTR not set on %s: %s", path, strerror(errno));
+    }
+    tcflush(device, TCIOFLUSH);
+    fd = device;
+    return true;
+}
+
+// The handshake waits for responses, so it runs outside of the receiving task
+void Tty::connection_task(void *arg)
+{
+    auto tty = static_cast<Tty *>(arg);
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        tty->onConnectionCallback();
+    }
+}
+
+void Tty::tty_task(void *arg)
+{
+    auto tty = static_cast<Tty *>(arg);
+    tty->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (tty->epollFd < 0)
+    {
+        ESP_LOGE(TAG, "Failed to create epoll: %s", strerror(errno));
+        abort();
+    }
+
+    std::minstd_rand random(std::random_device{}());
+    uint32_t attempt = 0;
+    while (true)
+    {
+        ESP_LOGI(TAG, "Opening %s...", tty->path);
+        if (!tty->open())
+        {
+            openFailures.increment();
+            uint32_t delay = backoffDelay(attempt++, random());
+            ESP_LOGI(TAG, "Failed to open device: %s. Retrying in %u ms", strerror(errno), static_cast<unsigned>(delay));
+            vTaskDelay(pdMS_TO_TICKS(delay));
+            continue;
+        }
+        attempt = 0;
+        boot::mark(boot::DeviceOpened);
+        tty->connected = true;
+        ESP_LOGI(TAG, "Connected");
+        xTaskNotifyGive(tty->connectionTask);
+        tty->receive();
+    }
+}
+
+// Reads until the device is gone or closed by reconnect
+void Tty::receive()
+{
+    while (connected)
+    {
+        epoll_event event;
+        int ready = epoll_wait(epollFd, &event, 1, RX_POLL_MS);
+        if (ready < 0 && errno != EINTR)
+        {
+            ESP_LOGE(TAG, "epoll failed: %s", strerror(errno));
+            errors.increment();
+            break;
+        }
+        if (ready <= 0)
+        {
+            continue;
+        }
+        if (event.events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+        {
+            ESP_LOGI(TAG, "Device suddenly disconnected");
+            break;
+        }
+        xSemaphoreTake(deviceMutex, portMAX_DELAY);
+        ssize_t length = connected ? read(fd, readBuffer, sizeof(readBuffer)) : 0;
+        xSemaphoreGive(deviceMutex);
+        if (length < 0 && (errno == EAGAIN || errno == EINTR))
+        {
+            continue;
+        }
+        if (length <= 0)
+        {
+            ESP_LOGI(TAG, "Device suddenly disconnected");
+            break;
+        }
+        TRACE(Usb, Debug, "Data received: %u bytes", length);
+        rxBytes.increment(length);
+        rxFill.record(length * 100 / sizeof(readBuffer));
+        std::vector<uint8_t> message(readBuffer, readBuffer + length);
+        onMessageCallback(message);
+    }
+    close();
+}
+
+void Tty::send(const uint8_t *data, size_t size)
+{
+    if (!connected)
+    {
+        return;
+    }
+    int error = 0;
+    int64_t deadline = esp_timer_get_time() + TX_TIMEOUT_MS * 1000LL;
+    xSemaphoreTake(deviceMutex, portMAX_DELAY);
+    for (size_t written = 0; connected && written < size;)
+    {
+        ssize_t count = write(fd, data + written, size - written);
+        if (count > 0)
+        {
+            written += count;
+            continue;
+        }
+        if (count < 0 && errno != EAGAIN && errno != EINTR)
+        {
+            error = errno;
+            break;
+        }
+        if (esp_timer_get_time() >= deadline)
+        {
+            error = ETIMEDOUT;
+            break;
+        }
+        pollfd pending = {fd, POLLOUT, 0};
+        poll(&pending, 1, RX_POLL_MS);
+    }
+    xSemaphoreGive(deviceMutex);
+    if (error)
+    {
+        errors.increment();
+        ESP_LOGE(TAG, "Failed to send data: %s", strerror(error));
+        return;
+    }
+    // Same pacing as the USB transport, the pedal needs time to apply a message
+    vTaskDelay(pdMS_TO_TICKS(100));
+}
+
+// Closes the device once, whichever of disconnect or reconnect comes first
+void Tty::close()
+{
+    xSemaphoreTake(deviceMutex, portMAX_DELAY);
+    bool wasConnected = connected.exchange(false);
+    if (fd >= 0)
+    {
+        // Closing removes the descriptor from the epoll set
+        ::close(fd);
+        fd = -1;
+    }
+    xSemaphoreGive(deviceMutex);
+    if (wasConnected)
+    {
+        onDisconnectionCallback();
+    }
+}
+
+void Tty::reconnect()
+{
+    ESP_LOGW(TAG, "Forcing reconnect");
+    reconnects.increment();
+    // The receive loop notices within RX_POLL_MS and opens the device again
+    close();
+}
+
+void Tty::setConnectionCallback(std::function<void(void)> callback)
+{
+    onConnectionCallback = callback;
+}
+
+void Tty::setDisconnectionCallback(std::function<void(void)> callback)
+{
+    onDisconnectionCallback = callback;
+}
+
+Tty *Tty::init(const char *path, std::function<void(const std::vector<uint8_t> &)> onMessageCallback)
+{
+    static Tty instance;
+    auto tty = &instance;
+    tty->path = path;
+    tty->onMessageCallback = onMessageCallback;
+    tty->deviceMutex = xSemaphoreCreateMutexStatic(&tty->deviceMutexBuffer);
+    report::addBuffer("tty", sizeof(readBuffer));
+    // Takes the place of the USB library task, which does not exist on this target
+    static report::TaskStorage<config::USB_LIB_TASK_STACK> connectionTaskStorage;
+    tty->connectionTask = report::createTask(connectionTaskStorage, Tty::connection_task, "tty_connection", tty, config::USB_LIB_TASK_PRIORITY, config::USB_LIB_TASK_CORE);
+    static report::TaskStorage<config::USB_HOST_TASK_STACK> taskStorage;
+    report::createTask(taskStorage, Tty::tty_task, "tty_task", tty, config::USB_HOST_TASK_PRIORITY, config::USB_HOST_TASK_CORE);
+    return tty;
+}
@@ -0,0 +1,62 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "transport.h"
+
+// Pedal connected to a Linux host, where it shows up as a CDC-ACM tty
+// (/dev/ttyACM*). Used on the linux target instead of the USB host stack.
+class Tty : public Transport {
+private:
+    const char *path = nullptr;
+    int fd = -1;
+    int epollFd = -1;
+    std::atomic<bool> connected{false};
+    SemaphoreHandle_t deviceMutex;
+    StaticSemaphore_t deviceMutexBuffer;
+    std::function<void(const std::vector<uint8_t>&)> onMessageCallback;
+    std::function<void(void)> onConnectionCallback;
+    std::function<void(void)> onDisconnectionCallback;
+    TaskHandle_t connectionTask = nullptr;
+    bool open();
+    void close();
+    void receive();
+    Tty() = default;
+public:
+    static void tty_task(void *arg);
+    static void connection_task(void *arg);
+    static Tty *init(const char *path, std::function<void(const std::vector<uint8_t>&)> onMessageCallback);
+    // TONEX_TTY environment variable, or the configured device
+    static const char *devicePath();
+    using Transport::send;
+    void send(const uint8_t *data, size_t size) override;
+    void setConnectionCallback(std::function<void(void)> callback) override;
+    void setDisconnectionCallback(std::function<void(void)> callback) override;
+    void reconnect() override;
+};
@@ -25,6 +25,13 @@
 #include "usb.h"
 
 #include "esp_log.h"
+#include "trace.h"
+#include "metrics.h"
+#include "esp_random.h"
+#include "sdkconfig.h"
+#include "config.h"
+#include "report.h"
+#include "boot.h"
 #include <vector>
 #include <numeric>
 #include <hal/usb_dwc_hal.h>
@@ -32,14 +39,46 @@
 static void usb_lib_task(void *arg);
 
 static SemaphoreHandle_t device_disconnected_sem;
+static StaticSemaphore_t device_disconnected_sem_buffer;
 
 static const char *TAG = "TONEX_CONTROLLER_USB";
 
+static const uint32_t TX_TIMEOUT_MS = 1000;
+
+// FIFO lines usable by the USB host controller of ESP32-S2/S3
+static const int FIFO_LINES = 200;
+static const int MAX_PACKET_SIZE = 64;
+static_assert(CONFIG_TONEX_USB_RX_FIFO_LINES + CONFIG_TONEX_USB_NPTX_FIFO_LINES + CONFIG_TONEX_USB_PTX_FIFO_LINES <= FIFO_LINES,
+              "USB host FIFO lines exceed the controller FIFO");
+static_assert(CONFIG_TONEX_USB_IN_BUFFER_SIZE % MAX_PACKET_SIZE == 0, "CDC IN transfer size must be a multiple of the packet size");
+
+static metrics::Counter openFailures("usb.open_failures");
+static metrics::Counter reconnects("usb.reconnects");
+static metrics::Counter errors("usb.errors");
+static metrics::Counter rxBytes("usb.rx_bytes");
+static metrics::Histogram rxFill("usb.rx_fill", "%");
+
+static esp_err_t setupLine(cdc_acm_dev_hdl_t cdc_dev)
+{
+    cdc_acm_line_coding_t line_coding;
+    line_coding.dwDTERate = 9600;
+    line_coding.bDataBits = 8;
+    line_coding.bParityType = 0;
+    line_coding.bCharFormat = 1;
+    // A failure closes the device and it is opened again with backoff. Readiness of the
+    // protocol is not known here, the handshake repeats its requests until answered.
+    esp_err_t err = cdc_acm_host_line_coding_set(cdc_dev, &line_coding);
+    if (err == ESP_OK)
+    {
+        err = cdc_acm_host_set_control_line_state(cdc_dev, true, false);
+    }
+    return err;
+}
+
 void USB::usb_host_task(void *arg)
 {
     auto usb = static_cast<USB *>(arg);
-    device_disconnected_sem = xSemaphoreCreateBinary();
-    assert(device_disconnected_sem);
+    device_disconnected_sem = xSemaphoreCreateBinaryStatic(&device_disconnected_sem_buffer);
 
     // Install USB Host driver. Should only be called once in entire application
     ESP_LOGI(TAG, "Installing USB Host");
@@ -47,28 +86,31 @@ void USB::usb_host_task(void *arg)
         .skip_phy_setup = false,
         .intr_flags = ESP_INTR_FLAG_LEVEL1,
         .fifo_settings_custom = {
-            .nptx_fifo_lines = 128, // Must be > 0
-            .ptx_fifo_lines = 32,  // Can be 0 if periodic TX endpoints are not used
-            .rx_fifo_lines = 32    // Must be > 0
+            .nptx_fifo_lines = CONFIG_TONEX_USB_NPTX_FIFO_LINES, // Must be > 0
+            .ptx_fifo_lines = CONFIG_TONEX_USB_PTX_FIFO_LINES,   // Can be 0 if periodic TX endpoints are not used
+            .rx_fifo_lines = CONFIG_TONEX_USB_RX_FIFO_LINES      // Must be > 0
         },
     };
     ESP_ERROR_CHECK(usb_host_install(&host_config));
+    boot::mark(boot::UsbHostInstalled);
 
     // Create a task that will handle USB library events
-    BaseType_t task_created = xTaskCreate(usb_lib_task, "usb_lib", 4096, xTaskGetCurrentTaskHandle(), 20, NULL);
-    assert(task_created == pdTRUE);
+    static report::TaskStorage<config::USB_LIB_TASK_STACK> libTaskStorage;
+    report::createTask(libTaskStorage, usb_lib_task, "usb_lib", xTaskGetCurrentTaskHandle(), config::USB_LIB_TASK_PRIORITY, config::USB_LIB_TASK_CORE);
 
     ESP_LOGI(TAG, "Installing CDC-ACM driver");
     ESP_ERROR_CHECK(cdc_acm_host_install(NULL));
+    boot::mark(boot::CdcInstalled);
 
     const cdc_acm_host_device_config_t dev_config = {
         .connection_timeout_ms = 1000,
-        .out_buffer_size = 1024,
-        .in_buffer_size = 1024,
+        .out_buffer_size = CONFIG_TONEX_USB_OUT_BUFFER_SIZE,
+        .in_buffer_size = CONFIG_TONEX_USB_IN_BUFFER_SIZE,
         .event_cb = USB::handle_event,
         .data_cb = USB::handle_rx,
         .user_arg = usb};
 
+    uint32_t attempt = 0;
     while (true)
     {
         usb->connected = false;
@@ -78,22 +120,32 @@ void USB::usb_host_task(void *arg)
         esp_err_t err = cdc_acm_host_open(usb->vid, usb->pid, 0, &dev_config, &(usb->cdc_dev));
         if (ESP_OK != err)
         {
-            ESP_LOGI(TAG, "Failed to open device");
+            openFailures.increment();
+            uint32_t delay = backoffDelay(attempt++, esp_random());
+            ESP_LOGI(TAG, "Failed to open device. Retrying in %u ms", static_cast<unsigned>(delay));
+            vTaskDelay(pdMS_TO_TICKS(delay));
             continue;
         }
-        vTaskDelay(pdMS_TO_TICKS(100));
-        cdc_acm_line_coding_t line_coding;
-        line_coding.dwDTERate = 9600;
-        line_coding.bDataBits = 8;
-        line_coding.bParityType = 0;
-        line_coding.bCharFormat = 1;
-        ESP_ERROR_CHECK(cdc_acm_host_line_coding_set(usb->cdc_dev, &line_coding));
-
-        ESP_ERROR_CHECK(cdc_acm_host_set_control_line_state(usb->cdc_dev, true, false));
+        err = setupLine(usb->cdc_dev);
+        if (ESP_OK != err)
+        {
+            ESP_LOGE(TAG, "Failed to set up line: %s", esp_err_to_name(err));
+            cdc_acm_host_close(usb->cdc_dev);
+            openFailures.increment();
+            vTaskDelay(pdMS_TO_TICKS(backoffDelay(attempt++, esp_random())));
+            continue;
+        }
+        attempt = 0;
+        boot::mark(boot::DeviceOpened);
         usb->connected = true;
         usb->onConnectionCallback();
         ESP_LOGI(TAG, "Connected");
         xSemaphoreTake(device_disconnected_sem, portMAX_DELAY);
+        // Closed here and not in the event callback: send holds the mutex for up to
+        // TX_TIMEOUT_MS and the callback runs in the task of the CDC-ACM driver
+        xSemaphoreTake(usb->deviceMutex, portMAX_DELAY);
+        ESP_ERROR_CHECK_WITHOUT_ABORT(cdc_acm_host_close(usb->cdc_dev));
+        xSemaphoreGive(usb->deviceMutex);
     }
 }
 
@@ -101,50 +153,88 @@ void USB::usb_host_task(void *arg)
 bool USB::handle_rx(const uint8_t *data, size_t data_len, void *arg)
 {
     auto usb = static_cast<USB *>(arg);
-    ESP_LOGI(TAG, "Data received");
+    TRACE(Usb, Debug, "Data received: %u bytes", data_len);
+    rxBytes.increment(data_len);
+    rxFill.record(data_len * 100 / CONFIG_TONEX_USB_IN_BUFFER_SIZE);
     std::vector<uint8_t> message(data, data + data_len);
     usb->onMessageCallback(message);
     return true;
 }
 
 
-void USB::send(const std::vector<uint8_t> &data)
+void USB::send(const uint8_t *data, size_t size)
 {
     if (!connected)
     {
         return;
     }
-    ESP_ERROR_CHECK(cdc_acm_host_data_tx_blocking(cdc_dev, data.data(), data.size(), portMAX_DELAY));
+    xSemaphoreTake(deviceMutex, portMAX_DELAY);
+    esp_err_t err = connected ? cdc_acm_host_data_tx_blocking(cdc_dev, data, size, TX_TIMEOUT_MS) : ESP_OK;
+    xSemaphoreGive(deviceMutex);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to send data: %s", esp_err_to_name(err));
+        return;
+    }
     vTaskDelay(pdMS_TO_TICKS(100));
 }
 
+// Hands the device over to the host task to be closed, once for whichever of disconnect
+// event or reconnect comes first. Does not block, so it is safe in the event callback.
+void USB::disconnect()
+{
+    if (connected.exchange(false))
+    {
+        // Before waking the host task, which may open the device again
+        onDisconnectionCallback();
+        xSemaphoreGive(device_disconnected_sem);
+    }
+}
+
+// Drops a device that is enumerated but not responding, the host task opens it again
+void USB::reconnect()
+{
+    ESP_LOGW(TAG, "Forcing reconnect");
+    reconnects.increment();
+    disconnect();
+}
+
 void USB::setConnectionCallback(std::function<void(void)> callback)
 {
     onConnectionCallback = callback;
 }
 
-std::unique_ptr<USB> USB::init(uint16_t vid, uint16_t pid, std::function<void(const std::vector<uint8_t> &)> onMessageCallback)
+void USB::setDisconnectionCallback(std::function<void(void)> callback)
 {
-    auto usb = new USB();
+    onDisconnectionCallback = callback;
+}
+
+USB *USB::init(uint16_t vid, uint16_t pid, std::function<void(const std::vector<uint8_t> &)> onMessageCallback)
+{
+    static USB instance;
+    auto usb = &instance;
     usb->pid = pid;
     usb->vid = vid;
     usb->onMessageCallback = onMessageCallback;
-    xTaskCreatePinnedToCore(USB::usb_host_task, "usb_host_task", 4096, usb, 5, NULL, 0);
-    return std::unique_ptr<USB>(usb);
+    usb->deviceMutex = xSemaphoreCreateMutexStatic(&usb->deviceMutexBuffer);
+    static report::TaskStorage<config::USB_HOST_TASK_STACK> taskStorage;
+    report::createTask(taskStorage, USB::usb_host_task, "usb_host_task", usb, config::USB_HOST_TASK_PRIORITY, config::USB_HOST_TASK_CORE);
+    return usb;
 }
 
 void USB::handle_event(const cdc_acm_host_dev_event_data_t *event, void *arg)
 {
-    // auto usb = static_cast<USB*>(arg);
+    auto usb = static_cast<USB*>(arg);
     switch (event->type)
     {
     case CDC_ACM_HOST_ERROR:
+        // A real hang is detected by the link supervisor in Tonex
+        errors.increment();
         ESP_LOGE(TAG, "CDC-ACM error has occurred, err_no = %i", event->data.error);
         break;
     case CDC_ACM_HOST_DEVICE_DISCONNECTED:
         ESP_LOGI(TAG, "Device suddenly disconnected");
-        ESP_ERROR_CHECK(cdc_acm_host_close(event->data.cdc_hdl));
-        xSemaphoreGive(device_disconnected_sem);
+        usb->disconnect();
         break;
     case CDC_ACM_HOST_SERIAL_STATE:
         ESP_LOGI(TAG, "Serial state notif 0x%04X", event->data.serial_state.val);
@@ -26,15 +26,21 @@
 
 #include <memory>
 #include <functional>
+#include <atomic>
 #include "usb/usb_host.h"
 #include "usb/cdc_acm_host.h"
+#include "transport.h"
 
-class USB {
+class USB : public Transport {
 private:
     cdc_acm_dev_hdl_t cdc_dev = nullptr;
-    bool connected = false;
+    std::atomic<bool> connected{false};
+    SemaphoreHandle_t deviceMutex;
+    StaticSemaphore_t deviceMutexBuffer;
+    void disconnect();
     std::function<void(const std::vector<uint8_t>&)> onMessageCallback;
     std::function<void(void)> onConnectionCallback;
+    std::function<void(void)> onDisconnectionCallback;
     uint16_t vid;
     uint16_t pid;
     USB() = default;
@@ -42,7 +48,10 @@ public:
     static void handle_event(const cdc_acm_host_dev_event_data_t *event, void *arg);
     static bool handle_rx(const uint8_t *data, size_t data_len, void *arg);
     static void usb_host_task(void* arg);
-    static std::unique_ptr<USB> init(uint16_t vid, uint16_t pid, std::function<void(const std::vector<uint8_t>&)> onMessageCallback);
-    void send(const std::vector<uint8_t>& data);
-    void setConnectionCallback(std::function<void(void)> callback);
+    static USB *init(uint16_t vid, uint16_t pid, std::function<void(const std::vector<uint8_t>&)> onMessageCallback);
+    using Transport::send;
+    void send(const uint8_t *data, size_t size) override;
+    void setConnectionCallback(std::function<void(void)> callback) override;
+    void setDisconnectionCallback(std::function<void(void)> callback) override;
+    void reconnect() override;
 };
@@ -0,0 +1,106 @@
+/* 
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Host check of the scene delta encoding in main/delta.cpp. Random states are
+// encoded against a base and must decode to themselves; truncated encodings
+// and encodings made against another base must be rejected. Exits with 1 on
+// the first failure.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "delta.h"
+
+static const int ROUNDS = 100000;
+static const size_t MAX_STATE = 256;
+
+static bool fail(const char *what, int round)
+{
+    printf("%s in round %d\n", what, round);
+    return false;
+}
+
+static bool checkRoundTrip()
+{
+    std::mt19937 random(1);
+    std::vector<uint8_t> encoded(delta::maxSize(MAX_STATE));
+    uint8_t decoded[MAX_STATE];
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        std::vector<uint8_t> base(random() % (MAX_STATE + 1));
+        for (auto &byte : base)
+        {
+            byte = random();
+        }
+        // Scenes differ from the base in a few places, sometimes everywhere, sometimes in size
+        std::vector<uint8_t> state(random() % 4 ? base.size() : random() % (MAX_STATE + 1));
+        int changeOneIn = 1 + random() % 64;
+        for (size_t i = 0; i < state.size(); i++)
+        {
+            state[i] = i < base.size() && random() % changeOneIn ? base[i] : random();
+        }
+
+        size_t length = delta::encode(base.data(), base.size(), state.data(), state.size(), encoded.data());
+        if (length > delta::maxSize(state.size()))
+        {
+            return fail("Encoding exceeds maxSize", round);
+        }
+        size_t size = 0;
+        if (!delta::decode(base.data(), base.size(), encoded.data(), length, decoded, sizeof(decoded), size) ||
+            size != state.size() || memcmp(decoded, state.data(), size))
+        {
+            return fail("Round trip differs", round);
+        }
+        if (length > delta::HEADER && delta::decode(base.data(), base.size(), encoded.data(), length - 1, decoded, sizeof(decoded), size))
+        {
+            return fail("Truncated encoding accepted", round);
+        }
+        if (!base.empty())
+        {
+            auto other = base;
+            other[random() % other.size()] ^= 1 + random() % 255;
+            if (delta::decode(other.data(), other.size(), encoded.data(), length, decoded, sizeof(decoded), size))
+            {
+                return fail("Encoding accepted against another base", round);
+            }
+            if (delta::decode(base.data(), base.size() - 1, encoded.data(), length, decoded, sizeof(decoded), size))
+            {
+                return fail("Encoding accepted against a shorter base", round);
+            }
+        }
+        if (state.size() && delta::decode(base.data(), base.size(), encoded.data(), length, decoded, state.size() - 1, size))
+        {
+            return fail("State larger than the capacity accepted", round);
+        }
+    }
+    printf("Round trip of %d states\n", ROUNDS);
+    return true;
+}
+
+int main()
+{
+    return checkRoundTrip() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,172 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Host tool for the HDLC framing in main/hdlc.cpp. Checks that it produces the
+// same frames and the same unframing results as the reference implementation
+// on random payloads and random garbage, then measures both on messages
+// shaped like the ones in protocol.md. Exits with 1 on the first mismatch.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include "hdlc.h"
+#include "hdlc_reference.h"
+
+static const int EQUIVALENCE_ROUNDS = 200000;
+static const size_t MAX_PAYLOAD = 300;
+static const size_t BENCH_BYTES = 200000000;
+
+// Flag and escape bytes are made frequent so the escaping paths are covered
+static uint8_t randomByte(std::mt19937 &random, int specialOneIn)
+{
+    return random() % specialOneIn == 0 ? hdlc::ESCAPE + random() % 2 : random();
+}
+
+static bool checkEquivalence()
+{
+    std::mt19937 random(1);
+    for (int round = 0; round < EQUIVALENCE_ROUNDS; round++)
+    {
+        std::vector<uint8_t> payload(random() % MAX_PAYLOAD);
+        for (auto &byte : payload)
+        {
+            byte = randomByte(random, 4);
+        }
+        auto framed = hdlc::addFraming(payload);
+        if (framed != hdlc_reference::addFraming(payload))
+        {
+            printf("addFraming differs for a %zu byte payload\n", payload.size());
+            return false;
+        }
+        auto [status, unframed] = hdlc::removeFraming(framed);
+        auto [referenceStatus, referenceUnframed] = hdlc_reference::removeFraming(framed);
+        if (status != referenceStatus || unframed != referenceUnframed || unframed != payload)
+        {
+            printf("removeFraming differs for a %zu byte payload\n", payload.size());
+            return false;
+        }
+
+        // Frames with broken escapes, stray flags and wrong CRCs
+        std::vector<uint8_t> garbage(payload.size() + 2);
+        for (auto &byte : garbage)
+        {
+            byte = randomByte(random, 3);
+        }
+        garbage.front() = hdlc::FLAG;
+        garbage.back() = hdlc::FLAG;
+        auto [garbageStatus, garbageUnframed] = hdlc::removeFraming(garbage);
+        auto [referenceGarbageStatus, referenceGarbageUnframed] = hdlc_reference::removeFraming(garbage);
+        if (garbageStatus != referenceGarbageStatus || garbageUnframed != referenceGarbageUnframed)
+        {
+            printf("removeFraming differs for %zu bytes of garbage: status %d, reference %d\n", garbage.size(), garbageStatus,
+                   referenceGarbageStatus);
+            return false;
+        }
+    }
+    printf("Equivalent on %d payloads and %d garbage frames\n", EQUIVALENCE_ROUNDS, EQUIVALENCE_ROUNDS);
+    return true;
+}
+
+// State changed message from protocol.md, header and body
+static std::vector<uint8_t> stateMessage()
+{
+    std::vector<uint8_t> message = {0xb9, 0x03, 0x81, 0x06, 0x03, 0x80, 0x97, 0x02,
+                                    0xb9, 0x01, 0xb9, 0x0b, 0x88, 0x00, 0x00, 0x70, 0x41, 0x88, 0x33, 0x33, 0x0b, 0x41,
+                                    0x00, 0x00, 0x01, 0xba, 0x14, 0xb9, 0x03, 0x00, 0x80, 0xff, 0x00, 0xb9, 0x03, 0x11, 0x00, 0x00};
+    for (int color = 2; color < 19; color++)
+    {
+        message.insert(message.end(), {0xb9, 0x03, 0x80, 0xff, 0x00, 0x00});
+    }
+    message.insert(message.end(), {0xb9, 0x03, 0x11, 0x00, 0x00, 0xbc, 0x06, 0x00, 0x00, 0x02, 0x00, 0x05, 0x00, 0x00, 0x00,
+                                   0x81, 0xd1, 0x01, 0x00, 0x00, 0x88, 0x00, 0x00, 0x70, 0x42});
+    return message;
+}
+
+// Preset response from protocol.md: name followed by float parameters up to
+// the 1180 (0x049c) byte body the pedal reports
+static std::vector<uint8_t> presetMessage()
+{
+    static const size_t BODY_SIZE = 0x049c;
+    std::vector<uint8_t> message = {0xb9, 0x03, 0x81, 0x04, 0x03, 0x81, 0x9c, 0x04, 0x02};
+    size_t bodyStart = message.size();
+    message.insert(message.end(), {0xb9, 0x03, 0x00, 0x00, 0xb9, 0x04, 0xb9, 0x02, 0xbc, 0x21});
+    const char name[33] = "BazPlexiTrebleCrunch";
+    message.insert(message.end(), name, name + sizeof(name));
+    message.insert(message.end(), {0x14, 0xba, 0x01, 0x88, 0x00, 0x00, 0x00, 0x00, 0xba, 0x03, 0xba, 0x29});
+    static const uint8_t parameters[][4] = {{0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0xc8, 0xc2}, {0x00, 0x00, 0xa0, 0x41},
+                                            {0x00, 0x00, 0x70, 0xc2}, {0x00, 0x00, 0x80, 0x3f}, {0x00, 0x00, 0x00, 0xc1},
+                                            {0x00, 0x00, 0xa0, 0x40}, {0x00, 0x00, 0x96, 0x43}, {0x33, 0x33, 0x33, 0x3f},
+                                            {0x00, 0x80, 0x3b, 0x44}, {0x00, 0x00, 0xfa, 0x44}, {0x00, 0x00, 0xc8, 0x42}};
+    for (size_t i = 0; message.size() - bodyStart + 5 <= BODY_SIZE; i++)
+    {
+        message.push_back(0x88);
+        message.insert(message.end(), parameters[i % std::size(parameters)], parameters[i % std::size(parameters)] + 4);
+    }
+    message.resize(bodyStart + BODY_SIZE);
+    return message;
+}
+
+template <typename Function>
+static void measure(const char *name, size_t size, Function function)
+{
+    size_t iterations = BENCH_BYTES / size;
+    size_t produced = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        produced += function().size();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // produced keeps the calls from being optimized away
+    printf("  %-26s %7.1f MB/s%s\n", name, iterations * size / seconds / 1e6, produced ? "" : " (no output)");
+}
+
+static void bench(const char *name, const std::vector<uint8_t> &message)
+{
+    auto framed = hdlc::addFraming(message);
+    printf("%s: %zu byte message, %zu byte frame\n", name, message.size(), framed.size());
+    measure("reference addFraming", message.size(), [&] { return hdlc_reference::addFraming(message); });
+    measure("addFraming", message.size(), [&] { return hdlc::addFraming(message); });
+    measure("reference removeFraming", message.size(), [&] { return std::get<1>(hdlc_reference::removeFraming(framed)); });
+    measure("removeFraming", message.size(), [&] { return std::get<1>(hdlc::removeFraming(framed)); });
+}
+
+int main(int argc, char **argv)
+{
+    if (!checkEquivalence())
+    {
+        return EXIT_FAILURE;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--check")
+    {
+        return EXIT_SUCCESS;
+    }
+    bench("State", stateMessage());
+    bench("Preset", presetMessage());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,254 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// FreeRTOS and esp_timer on std::thread for the host build. Just enough of their
+// behaviour for the firmware on the linux target: priorities, cores and stack
+// sizes are ignored and every task is a detached thread.
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const Clock::time_point start = Clock::now();
+
+struct Task
+{
+    std::string name;
+    std::mutex mutex;
+    std::condition_variable changed;
+    uint32_t notifications = 0;
+};
+
+// Binary semaphores and mutexes count up to 1, recursive mutexes have an owner
+struct Semaphore
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    int count = 0;
+    std::thread::id owner;
+    int depth = 0;
+};
+
+struct EventGroup
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    EventBits_t bits = 0;
+};
+
+static thread_local Task *currentTask = nullptr;
+
+template <typename Predicate>
+static bool waitFor(std::unique_lock<std::mutex> &lock, std::condition_variable &changed, TickType_t ticks, Predicate predicate)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        changed.wait(lock, predicate);
+        return true;
+    }
+    return changed.wait_for(lock, std::chrono::milliseconds(ticks), predicate);
+}
+
+int64_t esp_timer_get_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char *name, uint32_t, void *arg, UBaseType_t,
+                                           StackType_t *, StaticTask_t *, BaseType_t)
+{
+    auto task = new Task;
+    task->name = name;
+    std::thread([=] {
+        currentTask = task;
+        function(arg);
+    }).detach();
+    return task;
+}
+
+void vTaskDelete(TaskHandle_t)
+{
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return currentTask;
+}
+
+const char *pcTaskGetName(TaskHandle_t task)
+{
+    return static_cast<Task *>(task)->name.c_str();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t)
+{
+    return 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    std::unique_lock lock(currentTask->mutex);
+    waitFor(lock, currentTask->changed, ticks, [] { return currentTask->notifications > 0; });
+    uint32_t notifications = currentTask->notifications;
+    if (notifications)
+    {
+        currentTask->notifications = clear ? 0 : notifications - 1;
+    }
+    return notifications;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+    auto task = static_cast<Task *>(handle);
+    {
+        std::lock_guard lock(task->mutex);
+        task->notifications++;
+    }
+    task->changed.notify_all();
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *)
+{
+    return new Semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *)
+{
+    auto semaphore = new Semaphore;
+    semaphore->count = 1;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t *)
+{
+    return new Semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks)
+{
+    auto semaphore = static_cast<Semaphore *>(handle);
+    std::unique_lock lock(semaphore->mutex);
+    if (!waitFor(lock, semaphore->changed, ticks, [semaphore] { return semaphore->count > 0; }))
+    {
+        return pdFALSE;
+    }
+    semaphore->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle)
+{
+    auto semaphore = static_cast<Semaphore *>(handle);
+    {
+        std::lock_guard lock(semaphore->mutex);
+        semaphore->count = 1;
+    }
+    semaphore->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t handle, TickType_t ticks)
+{
+    auto semaphore = static_cast<Semaphore *>(handle);
+    std::unique_lock lock(semaphore->mutex);
+    if (semaphore->depth && semaphore->owner == std::this_thread::get_id())
+    {
+        semaphore->depth++;
+        return pdTRUE;
+    }
+    if (!waitFor(lock, semaphore->changed, ticks, [semaphore] { return semaphore->depth == 0; }))
+    {
+        return pdFALSE;
+    }
+    semaphore->owner = std::this_thread::get_id();
+    semaphore->depth = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t handle)
+{
+    auto semaphore = static_cast<Semaphore *>(handle);
+    {
+        std::lock_guard lock(semaphore->mutex);
+        semaphore->depth--;
+    }
+    semaphore->changed.notify_all();
+    return pdTRUE;
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *)
+{
+    return new EventGroup;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t handle, EventBits_t bits)
+{
+    auto group = static_cast<EventGroup *>(handle);
+    std::lock_guard lock(group->mutex);
+    group->bits |= bits;
+    group->changed.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t handle, EventBits_t bits)
+{
+    auto group = static_cast<EventGroup *>(handle);
+    std::lock_guard lock(group->mutex);
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t handle, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t ticks)
+{
+    auto group = static_cast<EventGroup *>(handle);
+    std::unique_lock lock(group->mutex);
+    waitFor(lock, group->changed, ticks, [&] { return all ? (group->bits & bits) == bits : (group->bits & bits) != 0; });
+    EventBits_t current = group->bits;
+    if (clear)
+    {
+        group->bits &= ~bits;
+    }
+    return current;
+}
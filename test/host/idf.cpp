@@ -0,0 +1,68 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Logging, error names and NVS of ESP-IDF for the host build. There is no
+// flash, so settings, mapping and scenes always start from their defaults.
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "ESP_FAIL";
+}
+
+void esp_log_level_set(const char *, esp_log_level_t)
+{
+}
+
+esp_err_t nvs_open(const char *, nvs_open_mode_t, nvs_handle_t *)
+{
+    return ESP_FAIL;
+}
+
+void nvs_close(nvs_handle_t)
+{
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t, const char *, void *, size_t *)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t, const char *, const void *, size_t)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t, const char *)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t nvs_commit(nvs_handle_t)
+{
+    return ESP_FAIL;
+}
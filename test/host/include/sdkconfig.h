@@ -0,0 +1,37 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Host build stand-ins for the parts of ESP-IDF used by the linux target,
+// implemented in test/host
+
+#pragma once
+
+// Defaults of main/Kconfig.projbuild
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_TONEX_USB_OUT_BUFFER_SIZE 1024
+#define CONFIG_TONEX_TTY_DEVICE "/dev/ttyACM0"
+#define CONFIG_TONEX_TRACE_LEVEL_USB 2
+#define CONFIG_TONEX_TRACE_LEVEL_TONEX 3
+#define CONFIG_TONEX_TRACE_LEVEL_MIDI 3
+#define CONFIG_TONEX_TRACE_RING_SIZE 64
@@ -0,0 +1,246 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 vit3k
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Host test of the linux target: the Tonex engine and the Tty transport in
+// main/ against a fake pedal on a pseudo terminal. The pedal answers the
+// requests of protocol.md, ignores the first ones like a pedal that is still
+// starting and sends a preset after each state like the real one does.
+// Exits with 1 on the first failed check.
+
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "hdlc.h"
+#include "metrics.h"
+#include "tonex.h"
+
+#define CHECK(condition)                                  \
+    do                                                    \
+    {                                                     \
+        if (!(condition))                                 \
+        {                                                 \
+            printf("Check failed: %s\n", #condition);     \
+            exit(EXIT_FAILURE);                           \
+        }                                                 \
+    } while (0)
+
+static const int IGNORED_REQUESTS = 2;
+static const size_t PRESET_BODY_SIZE = 1180;
+
+// State body of protocol.md, preset 2 in slot B and 5 in slot C
+static std::vector<uint8_t> pedalState = {
+    0xb9, 0x01, 0xb9, 0x0b, 0x88, 0x00, 0x00, 0x70, 0x41, 0x88, 0x33, 0x33, 0x0b, 0x41, 0x00, 0x00,
+    0x01, 0xba, 0x14, 0xb9, 0x03, 0x00, 0x80, 0xff, 0x00, 0xb9, 0x03, 0x11, 0x00, 0x00, 0xb9, 0x03,
+    0x80, 0xff, 0x3f, 0x00, 0xb9, 0x03, 0x80, 0xff, 0x00, 0x00, 0xb9, 0x03, 0x80, 0xff, 0x00, 0x00,
+    0xb9, 0x03, 0x80, 0xff, 0x00, 0x00, 0xb9, 0x03, 0x80, 0xff, 0x00, 0x00, 0xb9, 0x03, 0x80, 0xff,
+    0x00, 0x00, 0xb9, 0x03, 0x80, 0xff, 0x00, 0x00, 0xb9, 0x03, 0x80, 0xff, 0x00, 0x00, 0xb9, 0x03,
+    0x80, 0xff, 0x00, 0x00, 0xb9, 0x03, 0x80, 0xff, 0x00, 0x00, 0xb9, 0x03, 0x80, 0xff, 0x00, 0x00,
+    0xb9, 0x03, 0x80, 0xff, 0x00, 0x00, 0xb9, 0x03, 0x80, 0xff, 0x00, 0x00, 0xb9, 0x03, 0x80, 0xff,
+    0x00, 0x00, 0xb9, 0x03, 0x80, 0xff, 0x00, 0x00, 0xb9, 0x03, 0x80, 0xff, 0x00, 0x00, 0xb9, 0x03,
+    0x80, 0xff, 0x00, 0x00, 0xb9, 0x03, 0x11, 0x00, 0x00, 0xbc, 0x06, 0x00, 0x00, 0x02, 0x00, 0x05,
+    0x00, 0x00, 0x00, 0x81, 0xd1, 0x01, 0x00, 0x00, 0x88, 0x00, 0x00, 0x70, 0x42,
+};
+
+static int master = -1;
+static std::atomic<int> ignoredRequests{IGNORED_REQUESTS};
+static std::atomic<int> presetRequests{0};
+static std::atomic<bool> dropPresetResponse{false};
+
+static void reply(const std::vector<uint8_t> &message)
+{
+    auto framed = hdlc::addFraming(message);
+    // Writes to the pty stop short once the input buffer of the tty side is full,
+    // and fail once the test has unplugged the pedal
+    for (size_t written = 0; written < framed.size();)
+    {
+        ssize_t count = write(master, framed.data() + written, framed.size() - written);
+        if (count <= 0)
+        {
+            return;
+        }
+        written += count;
+    }
+}
+
+static void sendMessage(uint8_t type, const std::vector<uint8_t> &body)
+{
+    std::vector<uint8_t> message = {0xb9, 0x03, 0x81, type, 0x03, 0x82, static_cast<uint8_t>(body.size() & 0xff),
+                                    static_cast<uint8_t>(body.size() >> 8), 0x02};
+    message.insert(message.end(), body.begin(), body.end());
+    reply(message);
+}
+
+static void sendPreset(const char *text)
+{
+    char name[PRESET_NAME_SIZE - 1] = {};
+    snprintf(name, sizeof(name), "%s", text);
+    std::vector<uint8_t> body = {0xb9, 0x03, 0x00, 0x00, 0xb9, 0x04, 0xb9, 0x02, 0xbc, 0x21};
+    body.insert(body.end(), name, name + sizeof(name));
+    body.resize(PRESET_BODY_SIZE, 0x00);
+    sendMessage(0x04, body);
+}
+
+static void sendState()
+{
+    sendMessage(0x06, pedalState);
+    // Not asked for, the controller must not take it as the answer to a preset request
+    sendPreset("Active preset");
+}
+
+static void handle(const std::vector<uint8_t> &message)
+{
+    if (ignoredRequests > 0)
+    {
+        ignoredRequests--;
+        return;
+    }
+    if (message.size() > 9 && message[2] == 0x00 && message[8] == 0x01)
+    {
+        reply({0xb9, 0x03, 0x02, 0x04, 0x0b, 0xb9, 0x02, 0x02, 0x0b});
+    }
+    else if (message.size() > 9 && message[2] == 0x00 && message[8] == 0x03)
+    {
+        sendState();
+    }
+    else if (message.size() > 5 && message[2] == 0x81 && message[3] == 0x00 && message[4] == 0x03)
+    {
+        presetRequests++;
+        if (dropPresetResponse.exchange(false))
+        {
+            return;
+        }
+        char name[PRESET_NAME_SIZE];
+        snprintf(name, sizeof(name), "Preset %d", message.back());
+        sendPreset(name);
+    }
+    else if (message.size() > 11 && message[2] == 0x81 && message[3] == 0x06)
+    {
+        pedalState.assign(message.begin() + 11, message.end());
+        sendState();
+    }
+}
+
+// Splits the byte stream from the controller into frames until the test closes the pty
+static void pedal()
+{
+    std::vector<uint8_t> frame;
+    uint8_t data[4096];
+    ssize_t length;
+    while ((length = read(master, data, sizeof(data))) > 0)
+    {
+        for (ssize_t i = 0; i < length; i++)
+        {
+            frame.push_back(data[i]);
+            if (data[i] == hdlc::FLAG && frame.size() > 1)
+            {
+                auto [status, message] = hdlc::removeFraming(frame);
+                if (status == hdlc::Status::OK)
+                {
+                    handle(message);
+                }
+                frame.assign(1, hdlc::FLAG);
+            }
+        }
+    }
+}
+
+template <typename Predicate>
+static bool waitUntil(int timeoutMs, Predicate predicate)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (!predicate())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+static void checkPresetNames(Tonex &tonex)
+{
+    for (int i = 0; i < PRESET_COUNT; i++)
+    {
+        char expected[PRESET_NAME_SIZE];
+        char name[PRESET_NAME_SIZE];
+        snprintf(expected, sizeof(expected), "Preset %d", i);
+        CHECK(tonex.getPresetName(i, name, sizeof(name)) && strcmp(name, expected) == 0);
+    }
+}
+
+int main()
+{
+    int slave;
+    char path[64];
+    CHECK(openpty(&master, &slave, path, nullptr, nullptr) == 0);
+    termios options;
+    tcgetattr(master, &options);
+    cfmakeraw(&options);
+    tcsetattr(master, TCSANOW, &options);
+    setenv("TONEX_TTY", path, 1);
+    std::thread(pedal).detach();
+
+    static Tonex tonex;
+    tonex.init();
+    // Handshake repeated until the pedal answers
+    CHECK(waitUntil(5000, [] { return tonex.getConnectionState() == ConnectionState::StateInitialized; }));
+    CHECK(tonex.getPreset(Slot::B) == 2 && tonex.getPreset(Slot::C) == 5);
+
+    tonex.setSlot(Slot::B);
+    tonex.changePreset(Slot::A, 7);
+    CHECK(waitUntil(1000, [] { return pedalState[pedalState.size() - 11] == 1 && pedalState[pedalState.size() - 18] == 7; }));
+    CHECK(tonex.getCurrentSlot() == Slot::B && tonex.getPreset(Slot::A) == 7);
+
+    char name[PRESET_NAME_SIZE];
+    tonex.requestPresets();
+    CHECK(waitUntil(1000, [&] { return tonex.getPresetName(PRESET_COUNT - 1, name, sizeof(name)); }));
+    CHECK(presetRequests == PRESET_COUNT);
+    checkPresetNames(tonex);
+
+    // A lost answer and a state in between must not shift the names of the next fetch
+    dropPresetResponse = true;
+    tonex.requestPresets();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    tonex.requestState();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    tonex.requestPresets();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    checkPresetNames(tonex);
+
+    // Pedal unplugged: the tty hangs up
+    close(master);
+    CHECK(waitUntil(2000, [] { return tonex.getConnectionState() == ConnectionState::Disconnected; }));
+    metrics::print();
+    printf("Tty transport passed\n");
+    return EXIT_SUCCESS;
+}